@@ -0,0 +1,859 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "mgrip_index.h"
+#include "mx_stats.h"
+
+#define TRIGRAM_SPACE (1u << 24)
+#define SCAN_CHUNK (64 * 1024)
+#define NO_FILE UINT32_MAX
+/*
+ * Bytes of pairs held in memory before a sorted run is spilled; MGRIP_SORT_MEM
+ * overrides it. qsort needs about as much again while a run is sorted.
+ */
+#define SORT_MEM_DEFAULT (32u << 20)
+#define SORT_MEM_MIN 1024
+#define MERGE_MIN_BUFFER 512
+
+struct file_entry {
+    char *path;
+    uint64_t mtime_ns;
+    uint64_t size;
+};
+
+struct file_list {
+    struct file_entry *items;
+    size_t count;
+    size_t cap;
+};
+
+/* A sorted run in the spill file, and its read buffer while runs are merged. */
+struct pair_run {
+    uint64_t offset;
+    size_t count;
+    size_t next;
+    uint64_t *buf;
+    size_t pos;
+    size_t len;
+};
+
+/*
+ * (trigram << 32 | file id) pairs. At most limit of them are held in
+ * memory: when that fills up they are sorted and appended to an unlinked
+ * spill file as one run, and write_index merges the runs. A build that
+ * never fills the limit is sorted and read in memory.
+ */
+struct pair_list {
+    uint64_t *items;
+    size_t count;
+    size_t cap;
+    size_t limit;
+    const char *dir;
+    int spill_fd;
+    uint64_t spilled;
+    struct pair_run *runs;
+    size_t nruns;
+    size_t runs_cap;
+    size_t *heap;
+    size_t heap_len;
+    size_t merge_buffer;
+    size_t pos;
+};
+
+struct trigram_list {
+    uint32_t *items;
+    size_t count;
+    size_t cap;
+};
+
+struct mgrip_index {
+    unsigned char *base;
+    size_t size;
+    const struct mgrip_index_header *header;
+    const struct mgrip_index_file *files;
+    const char *names;
+    const struct mgrip_index_trigram *trigrams;
+    const unsigned char *postings;
+};
+
+static char *path_join(const char *dir, const char *name) {
+    size_t dir_len = strlen(dir);
+    size_t name_len = strlen(name);
+    char *path = (char *)malloc(dir_len + name_len + 2);
+    if (path == NULL) return NULL;
+    memcpy(path, dir, dir_len);
+    size_t pos = dir_len;
+    if (dir_len > 0 && dir[dir_len - 1] != '/') path[pos++] = '/';
+    memcpy(path + pos, name, name_len + 1);
+    return path;
+}
+
+static uint64_t stat_mtime_ns(const struct stat *st) {
+    return (uint64_t)st->st_mtim.tv_sec * 1000000000ull + (uint64_t)st->st_mtim.tv_nsec;
+}
+
+static int grow(void **items, size_t *cap, size_t need, size_t item_size) {
+    if (need <= *cap) return 0;
+    size_t new_cap = *cap ? *cap : 1024;
+    while (new_cap < need) new_cap *= 2;
+    void *grown = realloc(*items, new_cap * item_size);
+    if (grown == NULL) return -1;
+    *items = grown;
+    *cap = new_cap;
+    return 0;
+}
+
+static int compare_pairs(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static void pairs_init(struct pair_list *pairs, const char *dir) {
+    memset(pairs, 0, sizeof(*pairs));
+    pairs->dir = dir;
+    pairs->spill_fd = -1;
+    const char *env = getenv("MGRIP_SORT_MEM");
+    unsigned long long mem = env != NULL ? strtoull(env, NULL, 10) : SORT_MEM_DEFAULT;
+    if (mem < SORT_MEM_MIN) mem = SORT_MEM_MIN;
+    pairs->limit = (size_t)(mem / sizeof(uint64_t));
+}
+
+static void pairs_free(struct pair_list *pairs) {
+    for (size_t i = 0; i < pairs->nruns; ++i) free(pairs->runs[i].buf);
+    free(pairs->runs);
+    free(pairs->heap);
+    free(pairs->items);
+    if (pairs->spill_fd >= 0) close(pairs->spill_fd);
+}
+
+/* Forgets every pair pushed so far; the spill file is reused from the start. */
+static void pairs_reset(struct pair_list *pairs) {
+    pairs->count = 0;
+    pairs->nruns = 0;
+    pairs->spilled = 0;
+}
+
+/* An unnamed file next to the index, so a large build spills to the disk it indexes rather than to /tmp. */
+static int spill_open(struct pair_list *pairs) {
+    int fd = open(pairs->dir, O_TMPFILE | O_RDWR | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        char *path = path_join(pairs->dir, MGRIP_INDEX_NAME ".sortXXXXXX");
+        if (path == NULL) return -1;
+        fd = mkostemp(path, O_CLOEXEC);
+        if (fd >= 0) unlink(path);
+        free(path);
+    }
+    if (fd < 0) {
+        perror(pairs->dir);
+        return -1;
+    }
+    pairs->spill_fd = fd;
+    return 0;
+}
+
+static int spill_run(struct pair_list *pairs) {
+    if (pairs->spill_fd < 0 && spill_open(pairs) != 0) return -1;
+    if (grow((void **)&pairs->runs, &pairs->runs_cap, pairs->nruns + 1, sizeof(struct pair_run)) != 0) return -1;
+    qsort(pairs->items, pairs->count, sizeof(uint64_t), compare_pairs);
+    const unsigned char *data = (const unsigned char *)pairs->items;
+    size_t size = pairs->count * sizeof(uint64_t);
+    off_t offset = (off_t)(pairs->spilled * sizeof(uint64_t));
+    size_t done = 0;
+    while (done < size) {
+        ssize_t n = pwrite(pairs->spill_fd, data + done, size - done, offset + (off_t)done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            perror("grep: spilling index pairs");
+            return -1;
+        }
+        done += (size_t)n;
+    }
+    struct pair_run *run = &pairs->runs[pairs->nruns++];
+    memset(run, 0, sizeof(*run));
+    run->offset = pairs->spilled;
+    run->count = pairs->count;
+    pairs->spilled += pairs->count;
+    pairs->count = 0;
+    return 0;
+}
+
+static int pair_push(struct pair_list *pairs, uint32_t trigram, uint32_t file_id) {
+    if (pairs->count == pairs->limit && spill_run(pairs) != 0) return -1;
+    if (grow((void **)&pairs->items, &pairs->cap, pairs->count + 1, sizeof(uint64_t)) != 0) return -1;
+    pairs->items[pairs->count++] = (uint64_t)trigram << 32 | file_id;
+    return 0;
+}
+
+static int run_fill(struct pair_list *pairs, struct pair_run *run, size_t buf_len) {
+    size_t want = run->count - run->next < buf_len ? run->count - run->next : buf_len;
+    unsigned char *data = (unsigned char *)run->buf;
+    size_t size = want * sizeof(uint64_t);
+    off_t offset = (off_t)((run->offset + run->next) * sizeof(uint64_t));
+    size_t done = 0;
+    while (done < size) {
+        ssize_t n = pread(pairs->spill_fd, data + done, size - done, offset + (off_t)done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            perror("grep: reading spilled index pairs");
+            return -1;
+        }
+        done += (size_t)n;
+    }
+    run->next += want;
+    run->pos = 0;
+    run->len = want;
+    return 0;
+}
+
+static uint64_t run_head(const struct pair_list *pairs, size_t r) {
+    const struct pair_run *run = &pairs->runs[r];
+    return run->buf[run->pos];
+}
+
+static void heap_down(struct pair_list *pairs, size_t i) {
+    while (1) {
+        size_t smallest = i;
+        size_t left = 2 * i + 1;
+        size_t right = left + 1;
+        if (left < pairs->heap_len && run_head(pairs, pairs->heap[left]) < run_head(pairs, pairs->heap[smallest])) {
+            smallest = left;
+        }
+        if (right < pairs->heap_len && run_head(pairs, pairs->heap[right]) < run_head(pairs, pairs->heap[smallest])) {
+            smallest = right;
+        }
+        if (smallest == i) return;
+        size_t tmp = pairs->heap[i];
+        pairs->heap[i] = pairs->heap[smallest];
+        pairs->heap[smallest] = tmp;
+        i = smallest;
+    }
+}
+
+/* Readies pair_next: sorts in memory, or spills the tail and sets up a k-way merge of the runs. */
+static int pairs_finish(struct pair_list *pairs) {
+    pairs->pos = 0;
+    if (pairs->nruns == 0) {
+        qsort(pairs->items, pairs->count, sizeof(uint64_t), compare_pairs);
+        return 0;
+    }
+    if (pairs->count > 0 && spill_run(pairs) != 0) return -1;
+    free(pairs->items);
+    pairs->items = NULL;
+    pairs->cap = 0;
+
+    /* The read buffers share the memory budget the runs were cut to. */
+    size_t buf_len = pairs->limit / pairs->nruns;
+    if (buf_len < MERGE_MIN_BUFFER) buf_len = MERGE_MIN_BUFFER;
+    pairs->heap = (size_t *)malloc(pairs->nruns * sizeof(size_t));
+    if (pairs->heap == NULL) return -1;
+    for (size_t r = 0; r < pairs->nruns; ++r) {
+        struct pair_run *run = &pairs->runs[r];
+        run->buf = (uint64_t *)malloc(buf_len * sizeof(uint64_t));
+        if (run->buf == NULL || run_fill(pairs, run, buf_len) != 0) return -1;
+        pairs->heap[pairs->heap_len++] = r;
+    }
+    for (size_t i = pairs->heap_len / 2; i-- > 0;) heap_down(pairs, i);
+    pairs->merge_buffer = buf_len;
+    return 0;
+}
+
+/* Returns 1 with the next pair in ascending order, 0 at the end, -1 on a read error. */
+static int pair_next(struct pair_list *pairs, uint64_t *value) {
+    if (pairs->nruns == 0) {
+        if (pairs->pos == pairs->count) return 0;
+        *value = pairs->items[pairs->pos++];
+        return 1;
+    }
+    if (pairs->heap_len == 0) return 0;
+    size_t r = pairs->heap[0];
+    struct pair_run *run = &pairs->runs[r];
+    *value = run->buf[run->pos++];
+    if (run->pos == run->len) {
+        if (run->next < run->count) {
+            if (run_fill(pairs, run, pairs->merge_buffer) != 0) return -1;
+        } else {
+            pairs->heap[0] = pairs->heap[--pairs->heap_len];
+        }
+    }
+    if (pairs->heap_len > 0) heap_down(pairs, 0);
+    return 1;
+}
+
+static void write_varint(FILE *fp, uint32_t value, uint64_t *written) {
+    while (value >= 0x80) {
+        putc((int)(value | 0x80) & 0xFF, fp);
+        value >>= 7;
+        (*written)++;
+    }
+    putc((int)value, fp);
+    (*written)++;
+}
+
+static const unsigned char *get_varint(const unsigned char *p, const unsigned char *end, uint32_t *value) {
+    uint32_t result = 0;
+    for (int shift = 0; shift < 35 && p < end; shift += 7) {
+        unsigned char byte = *p++;
+        result |= (uint32_t)(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) {
+            *value = result;
+            return p;
+        }
+    }
+    return NULL;
+}
+
+static void index_close(struct mgrip_index *index) {
+    if (index->base != NULL) munmap(index->base, index->size);
+    index->base = NULL;
+}
+
+/* Returns 0 when path holds a usable index; -1 (with errno ENOENT if missing) otherwise. */
+static int index_open(const char *path, struct mgrip_index *index) {
+    memset(index, 0, sizeof(*index));
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(struct mgrip_index_header)) {
+        close(fd);
+        errno = EINVAL;
+        return -1;
+    }
+    void *base = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) return -1;
+    index->base = (unsigned char *)base;
+    index->size = (size_t)st.st_size;
+
+    const struct mgrip_index_header *h = (const struct mgrip_index_header *)base;
+    uint64_t size = index->size;
+    if (memcmp(h->magic, MGRIP_INDEX_MAGIC, 4) != 0 || h->version != MGRIP_INDEX_VERSION ||
+        h->index_size != size || h->files_offset > size || h->names_offset > h->postings_offset ||
+        h->postings_offset > h->trigrams_offset || h->trigrams_offset > size ||
+        (size - h->files_offset) / sizeof(struct mgrip_index_file) < h->file_count ||
+        (size - h->trigrams_offset) / sizeof(struct mgrip_index_trigram) < h->trigram_count) {
+        index_close(index);
+        errno = EINVAL;
+        return -1;
+    }
+    index->header = h;
+    index->files = (const struct mgrip_index_file *)(index->base + h->files_offset);
+    index->names = (const char *)(index->base + h->names_offset);
+    index->trigrams = (const struct mgrip_index_trigram *)(index->base + h->trigrams_offset);
+    index->postings = index->base + h->postings_offset;
+    for (uint32_t i = 0; i < h->file_count; ++i) {
+        const struct mgrip_index_file *f = &index->files[i];
+        if ((uint64_t)f->name_offset + f->name_len > h->postings_offset - h->names_offset) {
+            index_close(index);
+            errno = EINVAL;
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* Decodes a posting list into ids (room for entry->count); returns the count, or -1 if corrupt. */
+static long index_postings(const struct mgrip_index *index, const struct mgrip_index_trigram *entry, uint32_t *ids) {
+    const unsigned char *end = index->base + index->size;
+    if (entry->postings > (uint64_t)(end - index->postings)) return -1;
+    const unsigned char *p = index->postings + entry->postings;
+    uint32_t id = 0;
+    for (uint32_t i = 0; i < entry->count; ++i) {
+        uint32_t gap;
+        p = get_varint(p, end, &gap);
+        if (p == NULL) return -1;
+        id = i == 0 ? gap : id + gap;
+        if (id >= index->header->file_count) return -1;
+        ids[i] = id;
+    }
+    return (long)entry->count;
+}
+
+static const struct mgrip_index_trigram *index_find(const struct mgrip_index *index, uint32_t trigram) {
+    size_t lo = 0;
+    size_t hi = index->header->trigram_count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        uint32_t value = index->trigrams[mid].trigram;
+        if (value == trigram) return &index->trigrams[mid];
+        if (value < trigram) lo = mid + 1;
+        else hi = mid;
+    }
+    return NULL;
+}
+
+/* strcmp order of file id's path against path, the order both file tables are sorted in. */
+static int index_compare_file(const struct mgrip_index *index, uint32_t id, const char *path, size_t path_len) {
+    const struct mgrip_index_file *f = &index->files[id];
+    size_t n = f->name_len < path_len ? f->name_len : path_len;
+    int cmp = memcmp(index->names + f->name_offset, path, n);
+    if (cmp == 0) cmp = f->name_len < path_len ? -1 : f->name_len > path_len;
+    return cmp;
+}
+
+static long index_find_file(const struct mgrip_index *index, const char *path) {
+    size_t path_len = strlen(path);
+    size_t lo = 0;
+    size_t hi = index->header->file_count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        int cmp = index_compare_file(index, (uint32_t)mid, path, path_len);
+        if (cmp == 0) return (long)mid;
+        if (cmp < 0) lo = mid + 1;
+        else hi = mid;
+    }
+    return -1;
+}
+
+static int walk_dir(const char *root, const char *rel, struct file_list *files) {
+    char *full = rel[0] ? path_join(root, rel) : strdup(root);
+    if (full == NULL) return -1;
+    DIR *d = opendir(full);
+    if (d == NULL) {
+        perror(full);
+        free(full);
+        return 0;
+    }
+    int ret = 0;
+    struct dirent *entry;
+    while (ret == 0 && (entry = readdir(d)) != NULL) {
+        const char *name = entry->d_name;
+        if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) continue;
+        if (rel[0] == '\0' && strncmp(name, MGRIP_INDEX_NAME, strlen(MGRIP_INDEX_NAME)) == 0) continue;
+        struct stat st;
+        if (fstatat(dirfd(d), name, &st, AT_SYMLINK_NOFOLLOW) != 0) continue;
+        char *child = rel[0] ? path_join(rel, name) : strdup(name);
+        if (child == NULL) {
+            ret = -1;
+            break;
+        }
+        if (S_ISDIR(st.st_mode)) {
+            ret = walk_dir(root, child, files);
+            free(child);
+        } else if (S_ISREG(st.st_mode)) {
+            if (grow((void **)&files->items, &files->cap, files->count + 1, sizeof(struct file_entry)) != 0) {
+                free(child);
+                ret = -1;
+                break;
+            }
+            struct file_entry *f = &files->items[files->count++];
+            f->path = child;
+            f->mtime_ns = stat_mtime_ns(&st);
+            f->size = (uint64_t)st.st_size;
+        } else {
+            free(child);
+        }
+    }
+    closedir(d);
+    free(full);
+    return ret;
+}
+
+static void free_files(struct file_list *files) {
+    for (size_t i = 0; i < files->count; ++i) free(files->items[i].path);
+    free(files->items);
+}
+
+static int compare_files(const void *a, const void *b) {
+    return strcmp(((const struct file_entry *)a)->path, ((const struct file_entry *)b)->path);
+}
+
+/*
+ * Adds one pair per distinct trigram in the file. Trigrams spanning a
+ * newline are left out: the scanner matches within a line, so no pattern
+ * can contain one. The file is read up to its size at open time, and that
+ * size and mtime are what the index records.
+ */
+static int scan_file(const char *root, struct file_entry *file, uint32_t file_id, unsigned char *seen,
+                     unsigned char *buffer, struct trigram_list *found, struct pair_list *pairs) {
+    char *full = path_join(root, file->path);
+    if (full == NULL) return -1;
+    int fd = open(full, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0) {
+        perror(full);
+        free(full);
+        return 0;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        close(fd);
+        free(full);
+        return 0;
+    }
+    file->mtime_ns = stat_mtime_ns(&st);
+    file->size = (uint64_t)st.st_size;
+
+    found->count = 0;
+    size_t left = (size_t)st.st_size;
+    size_t carry = 0;
+    int ret = 0;
+    while (ret == 0 && left > 0) {
+        ssize_t n = read(fd, buffer + carry, left < SCAN_CHUNK ? left : SCAN_CHUNK);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) perror(full);
+        if (n <= 0) break;
+        MX_STAT_ADD(MX_STAT_BYTES_READ, n);
+        left -= (size_t)n;
+        size_t len = carry + (size_t)n;
+        for (size_t i = 0; i + 3 <= len; ++i) {
+            if (buffer[i] == '\n' || buffer[i + 1] == '\n' || buffer[i + 2] == '\n') continue;
+            uint32_t trigram = (uint32_t)buffer[i] << 16 | (uint32_t)buffer[i + 1] << 8 | buffer[i + 2];
+            if (seen[trigram >> 3] & (1u << (trigram & 7))) continue;
+            seen[trigram >> 3] |= (unsigned char)(1u << (trigram & 7));
+            if (grow((void **)&found->items, &found->cap, found->count + 1, sizeof(uint32_t)) != 0) {
+                ret = -1;
+                break;
+            }
+            found->items[found->count++] = trigram;
+        }
+        /* The last two bytes start trigrams that end in the next chunk. */
+        carry = len < 2 ? len : 2;
+        memmove(buffer, buffer + len - carry, carry);
+    }
+    for (size_t i = 0; i < found->count; ++i) {
+        seen[found->items[i] >> 3] = 0;
+        if (ret == 0 && pair_push(pairs, found->items[i], file_id) != 0) ret = -1;
+    }
+    close(fd);
+    free(full);
+    return ret;
+}
+
+/* Re-emits the old postings of files that have not changed since the last build. */
+static int reuse_postings(const struct mgrip_index *old, const uint32_t *old_to_new, struct pair_list *pairs) {
+    uint32_t *ids = (uint32_t *)malloc((old->header->file_count ? old->header->file_count : 1) * sizeof(uint32_t));
+    if (ids == NULL) return -1;
+    for (uint32_t t = 0; t < old->header->trigram_count; ++t) {
+        const struct mgrip_index_trigram *entry = &old->trigrams[t];
+        if (entry->count > old->header->file_count) {
+            free(ids);
+            return -1;
+        }
+        long count = index_postings(old, entry, ids);
+        if (count < 0) {
+            free(ids);
+            return -1;
+        }
+        for (long i = 0; i < count; ++i) {
+            uint32_t new_id = old_to_new[ids[i]];
+            if (new_id != NO_FILE && pair_push(pairs, entry->trigram, new_id) != 0) {
+                free(ids);
+                return -1;
+            }
+        }
+    }
+    free(ids);
+    return 0;
+}
+
+/*
+ * Writes the header, file table and names, then streams the sorted pairs
+ * into delta-encoded posting lists while collecting the trigram table,
+ * which goes last. The header is rewritten once the offsets are known.
+ */
+static int write_index(const char *path, const struct file_list *files, struct pair_list *pairs,
+                       uint32_t *ntrigrams, uint64_t *index_size) {
+    size_t names_size = 0;
+    for (size_t i = 0; i < files->count; ++i) names_size += strlen(files->items[i].path);
+    struct mgrip_index_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, MGRIP_INDEX_MAGIC, 4);
+    header.version = MGRIP_INDEX_VERSION;
+    header.file_count = (uint32_t)files->count;
+    header.files_offset = sizeof(header);
+    header.names_offset = header.files_offset + files->count * sizeof(struct mgrip_index_file);
+    header.postings_offset = header.names_offset + names_size;
+
+    FILE *fp = fopen(path, "wb");
+    if (fp == NULL) {
+        perror(path);
+        return -1;
+    }
+    fwrite(&header, sizeof(header), 1, fp);
+    uint32_t name_offset = 0;
+    for (size_t i = 0; i < files->count; ++i) {
+        struct mgrip_index_file f;
+        f.mtime_ns = files->items[i].mtime_ns;
+        f.size = files->items[i].size;
+        f.name_offset = name_offset;
+        f.name_len = (uint32_t)strlen(files->items[i].path);
+        name_offset += f.name_len;
+        fwrite(&f, sizeof(f), 1, fp);
+    }
+    for (size_t i = 0; i < files->count; ++i) {
+        fputs(files->items[i].path, fp);
+    }
+
+    struct mgrip_index_trigram *trigrams = NULL;
+    size_t trigrams_cap = 0;
+    uint32_t count = 0;
+    uint64_t postings_size = 0;
+    uint32_t prev = 0;
+    uint64_t pair;
+    int ret;
+    while ((ret = pair_next(pairs, &pair)) == 1) {
+        uint32_t trigram = (uint32_t)(pair >> 32);
+        uint32_t id = (uint32_t)pair;
+        if (count == 0 || trigrams[count - 1].trigram != trigram) {
+            if (grow((void **)&trigrams, &trigrams_cap, count + 1, sizeof(*trigrams)) != 0) {
+                fprintf(stderr, "grep: out of memory building index\n");
+                ret = -1;
+                break;
+            }
+            struct mgrip_index_trigram *entry = &trigrams[count++];
+            entry->trigram = trigram;
+            entry->count = 0;
+            entry->postings = postings_size;
+            prev = 0;
+        }
+        struct mgrip_index_trigram *entry = &trigrams[count - 1];
+        write_varint(fp, entry->count == 0 ? id : id - prev, &postings_size);
+        prev = id;
+        entry->count++;
+    }
+    if (ret == 0) {
+        header.trigram_count = count;
+        header.trigrams_offset = (header.postings_offset + postings_size + 7) & ~(uint64_t)7;
+        header.index_size = header.trigrams_offset + (uint64_t)count * sizeof(struct mgrip_index_trigram);
+        static const char padding[8];
+        fwrite(padding, 1, header.trigrams_offset - header.postings_offset - postings_size, fp);
+        fwrite(trigrams, sizeof(*trigrams), count, fp);
+        if (fseek(fp, 0, SEEK_SET) != 0 || fwrite(&header, sizeof(header), 1, fp) != 1) ret = -1;
+    }
+    free(trigrams);
+    if (fclose(fp) != 0 || ret != 0) {
+        if (ret == 0) perror(path);
+        unlink(path);
+        return -1;
+    }
+    MX_STAT_ADD(MX_STAT_BYTES_WRITTEN, header.index_size);
+    *ntrigrams = count;
+    *index_size = header.index_size;
+    return 0;
+}
+
+/* Marks files whose mtime and size match the old index and re-emits their postings. */
+static size_t reuse_unchanged(const char *index_path, const struct file_list *files, unsigned char *reused,
+                              struct pair_list *pairs) {
+    struct mgrip_index old;
+    if (index_open(index_path, &old) != 0) {
+        if (errno != ENOENT) fprintf(stderr, "grep: ignoring unusable index %s\n", index_path);
+        return 0;
+    }
+    uint32_t *old_to_new = (uint32_t *)malloc((old.header->file_count ? old.header->file_count : 1) * sizeof(uint32_t));
+    if (old_to_new == NULL) {
+        index_close(&old);
+        return 0;
+    }
+    for (uint32_t i = 0; i < old.header->file_count; ++i) old_to_new[i] = NO_FILE;
+    size_t reused_count = 0;
+    for (size_t i = 0; i < files->count; ++i) {
+        long old_id = index_find_file(&old, files->items[i].path);
+        if (old_id < 0) continue;
+        const struct mgrip_index_file *f = &old.files[old_id];
+        if (f->mtime_ns == files->items[i].mtime_ns && f->size == files->items[i].size) {
+            old_to_new[old_id] = (uint32_t)i;
+            reused[i] = 1;
+            reused_count++;
+        }
+    }
+    if (reuse_postings(&old, old_to_new, pairs) != 0) {
+        /* Unreadable postings: forget the old index and rescan everything. */
+        pairs_reset(pairs);
+        memset(reused, 0, files->count);
+        reused_count = 0;
+    }
+    free(old_to_new);
+    index_close(&old);
+    return reused_count;
+}
+
+static int index_files(const char *dir, struct file_list *files, const char *index_path, const char *tmp_path) {
+    unsigned char *seen = (unsigned char *)calloc(TRIGRAM_SPACE / 8, 1);
+    unsigned char *buffer = (unsigned char *)malloc(SCAN_CHUNK + 2);
+    unsigned char *reused = (unsigned char *)calloc(files->count ? files->count : 1, 1);
+    struct trigram_list found = {0};
+    struct pair_list pairs;
+    pairs_init(&pairs, dir);
+    uint32_t ntrigrams = 0;
+    uint64_t index_size = 0;
+    int status = 1;
+
+    if (seen == NULL || buffer == NULL || reused == NULL) {
+        fprintf(stderr, "grep: out of memory\n");
+    } else {
+        size_t reused_count = reuse_unchanged(index_path, files, reused, &pairs);
+        size_t i = 0;
+        for (; i < files->count; ++i) {
+            if (reused[i]) continue;
+            if (scan_file(dir, &files->items[i], (uint32_t)i, seen, buffer, &found, &pairs) != 0) {
+                fprintf(stderr, "grep: cannot index %s\n", files->items[i].path);
+                break;
+            }
+        }
+        if (i == files->count) {
+            if (pairs_finish(&pairs) != 0) {
+                fprintf(stderr, "grep: cannot sort index pairs\n");
+            } else if (write_index(tmp_path, files, &pairs, &ntrigrams, &index_size) == 0) {
+                if (rename(tmp_path, index_path) != 0) {
+                    perror(index_path);
+                    unlink(tmp_path);
+                } else {
+                    printf("Indexed %zu files (%zu unchanged), %u trigrams, %llu bytes: %s\n", files->count,
+                           reused_count, ntrigrams, (unsigned long long)index_size, index_path);
+                    status = 0;
+                }
+            }
+        }
+    }
+    free(seen);
+    free(buffer);
+    free(reused);
+    free(found.items);
+    pairs_free(&pairs);
+    return status;
+}
+
+/*
+ * Files whose mtime and size match the previous index keep their postings;
+ * only new or changed files are read. The index is written next to the old
+ * one and renamed over it, so readers never see a partial file.
+ */
+int mgrip_build_index(const char *dir) {
+    struct file_list files = {0};
+    int status = 1;
+    if (walk_dir(dir, "", &files) != 0) {
+        fprintf(stderr, "grep: out of memory walking %s\n", dir);
+    } else {
+        qsort(files.items, files.count, sizeof(struct file_entry), compare_files);
+        /* Per process, so concurrent builds never rename each other's partial file into place. */
+        char tmp_name[sizeof(MGRIP_INDEX_NAME ".tmp.") + 24];
+        snprintf(tmp_name, sizeof(tmp_name), MGRIP_INDEX_NAME ".tmp.%ld", (long)getpid());
+        char *index_path = path_join(dir, MGRIP_INDEX_NAME);
+        char *tmp_path = path_join(dir, tmp_name);
+        if (index_path != NULL && tmp_path != NULL) {
+            status = index_files(dir, &files, index_path, tmp_path);
+        }
+        free(index_path);
+        free(tmp_path);
+    }
+    free_files(&files);
+    return status;
+}
+
+/* Intersects the posting lists of every trigram in pattern into candidate[]; 0 on success. */
+static int mark_candidates(const struct mgrip_index *index, const char *pattern, unsigned char *candidate) {
+    size_t len = strlen(pattern);
+    const struct mgrip_index_trigram *shortest = NULL;
+    for (size_t i = 0; i + 3 <= len; ++i) {
+        const unsigned char *p = (const unsigned char *)pattern + i;
+        const struct mgrip_index_trigram *entry = index_find(index, (uint32_t)p[0] << 16 | (uint32_t)p[1] << 8 | p[2]);
+        if (entry == NULL) return 0;
+        if (shortest == NULL || entry->count < shortest->count) shortest = entry;
+    }
+    if (shortest == NULL || shortest->count > index->header->file_count) return shortest == NULL ? 0 : -1;
+
+    uint32_t *ids = (uint32_t *)malloc((shortest->count + 1) * sizeof(uint32_t));
+    uint32_t *other = (uint32_t *)malloc((index->header->file_count + 1) * sizeof(uint32_t));
+    long count = ids != NULL && other != NULL ? index_postings(index, shortest, ids) : -1;
+    for (size_t i = 0; count > 0 && i + 3 <= len; ++i) {
+        const unsigned char *p = (const unsigned char *)pattern + i;
+        const struct mgrip_index_trigram *entry = index_find(index, (uint32_t)p[0] << 16 | (uint32_t)p[1] << 8 | p[2]);
+        if (entry == shortest) continue;
+        long other_count = entry->count <= index->header->file_count ? index_postings(index, entry, other) : -1;
+        if (other_count < 0) {
+            count = -1;
+            break;
+        }
+        long kept = 0;
+        long j = 0;
+        for (long k = 0; k < count; ++k) {
+            while (j < other_count && other[j] < ids[k]) j++;
+            if (j < other_count && other[j] == ids[k]) ids[kept++] = ids[k];
+        }
+        count = kept;
+    }
+    for (long k = 0; k < count; ++k) candidate[ids[k]] = 1;
+    free(ids);
+    free(other);
+    return count < 0 ? -1 : 0;
+}
+
+/*
+ * The directory is walked again and merged with the file table, both
+ * sorted by path. Files the index knows with the same mtime and size are
+ * scanned only if they are candidates; changed and added files are always
+ * scanned, since the index says nothing about their content.
+ */
+int mgrip_index_search(const char *dir, const char *pattern, int match_all, mgrip_scan_fn scan, void *arg) {
+    char *index_path = path_join(dir, MGRIP_INDEX_NAME);
+    if (index_path == NULL) return -1;
+    struct mgrip_index index;
+    if (index_open(index_path, &index) != 0) {
+        if (errno == ENOENT) {
+            fprintf(stderr, "grep: no index in %s; run grep --build-index %s\n", dir, dir);
+        } else {
+            fprintf(stderr, "grep: unusable index %s; run grep --build-index %s\n", index_path, dir);
+        }
+        free(index_path);
+        return -1;
+    }
+    free(index_path);
+
+    uint32_t file_count = index.header->file_count;
+    unsigned char *candidate = (unsigned char *)calloc(file_count ? file_count : 1, 1);
+    struct file_list files = {0};
+    if (candidate == NULL || walk_dir(dir, "", &files) != 0) {
+        fprintf(stderr, "grep: out of memory searching %s\n", dir);
+        free(candidate);
+        free_files(&files);
+        index_close(&index);
+        return -1;
+    }
+    if (match_all || strlen(pattern) < 3) {
+        memset(candidate, 1, file_count);
+    } else if (mark_candidates(&index, pattern, candidate) != 0) {
+        fprintf(stderr, "grep: corrupt index in %s; run grep --build-index %s\n", dir, dir);
+        free(candidate);
+        free_files(&files);
+        index_close(&index);
+        return -1;
+    }
+    qsort(files.items, files.count, sizeof(struct file_entry), compare_files);
+
+    size_t stale = 0;
+    uint32_t id = 0;
+    for (size_t i = 0; i < files.count; ++i) {
+        const struct file_entry *file = &files.items[i];
+        size_t path_len = strlen(file->path);
+        int cmp = 1;
+        while (id < file_count && (cmp = index_compare_file(&index, id, file->path, path_len)) < 0) id++;
+        int changed = 1;
+        if (id < file_count && cmp == 0) {
+            const struct mgrip_index_file *f = &index.files[id];
+            changed = f->mtime_ns != file->mtime_ns || f->size != file->size;
+        }
+        if (changed) stale++;
+        if (changed || candidate[id]) {
+            char *full = path_join(dir, file->path);
+            if (full == NULL) break;
+            scan(full, arg);
+            free(full);
+        }
+    }
+    if (stale > 0) {
+        fprintf(stderr, "grep: %zu files added or changed since %s was indexed; run grep --build-index %s\n",
+                stale, dir, dir);
+    }
+    free(candidate);
+    free_files(&files);
+    index_close(&index);
+    return 0;
+}
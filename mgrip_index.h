@@ -0,0 +1,49 @@
+#ifndef MGRIP_INDEX_H
+#define MGRIP_INDEX_H
+
+#include <stdint.h>
+
+#define MGRIP_INDEX_NAME ".mxgrip.idx"
+#define MGRIP_INDEX_MAGIC "MXGI"
+#define MGRIP_INDEX_VERSION 2
+
+/*
+ * On-disk layout, little-endian and meant to be mmapped: the header, one
+ * mgrip_index_file per file sorted by path, the path strings, the posting
+ * lists, then one mgrip_index_trigram per trigram sorted by value, 8-byte
+ * aligned. A posting list holds the ids of files containing the trigram,
+ * ascending, as LEB128 varints of the gap to the previous id. Version 2
+ * moved the postings ahead of the trigram table so they can be streamed.
+ */
+struct mgrip_index_header {
+    char magic[4];
+    uint32_t version;
+    uint32_t file_count;
+    uint32_t trigram_count;
+    uint64_t files_offset;
+    uint64_t names_offset;
+    uint64_t trigrams_offset;
+    uint64_t postings_offset;
+    uint64_t index_size;
+};
+
+struct mgrip_index_file {
+    uint64_t mtime_ns;
+    uint64_t size;
+    uint32_t name_offset;
+    uint32_t name_len;
+};
+
+struct mgrip_index_trigram {
+    uint32_t trigram;
+    uint32_t count;
+    uint64_t postings;
+};
+
+typedef void (*mgrip_scan_fn)(const char *path, void *arg);
+
+int mgrip_build_index(const char *dir);
+/* Calls scan for every file that may contain pattern; all files when match_all is set. */
+int mgrip_index_search(const char *dir, const char *pattern, int match_all, mgrip_scan_fn scan, void *arg);
+
+#endif
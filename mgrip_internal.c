@@ -1,11 +1,16 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <unistd.h>
 #include <ctype.h>
 #include <getopt.h>
+#include "mx_stats.h"
+#include "mgrip_index.h"
 
-#define MAX_LINE_LEN 4096
+#define GREP_READ_SIZE (64 * 1024)
 
 #define GREEN_COLOR "\033[32m"
 #define RESET_COLOR "\033[0m"
@@ -13,6 +18,8 @@
 
 int opt_s_only_match = 0;
 int opt_n_line_numbers = 0;
+/* Set while scanning index candidates, so each output line names its file. */
+const char *opt_line_prefix = NULL;
 
 
 enum MatchFilterType {
@@ -45,6 +52,9 @@ static int process_line(char *line, const char *pattern, int line_num) {
 
     if (opt_s_only_match) {
         while ((match_pos = strstr(current_pos, pattern)) != NULL) {
+            if (matches_count == 0 && opt_line_prefix) {
+                printf("%s:", opt_line_prefix);
+            }
             matches_count++;
             printf(GREEN_COLOR);
             print_substring(match_pos, 0, strlen(pattern));
@@ -57,6 +67,7 @@ static int process_line(char *line, const char *pattern, int line_num) {
         if (matches_count > 0) {
             putchar('\n');
         }
+        MX_STAT_ADD(MX_STAT_MATCHES, matches_count);
     } else {
 
         char *temp_pos = line;
@@ -64,6 +75,7 @@ static int process_line(char *line, const char *pattern, int line_num) {
             matches_count++;
             temp_pos = strstr(temp_pos, pattern) + strlen(pattern);
         }
+        MX_STAT_ADD(MX_STAT_MATCHES, matches_count);
 
         int filter_passed = 0;
         switch (opt_m_filter_type) {
@@ -76,6 +88,9 @@ static int process_line(char *line, const char *pattern, int line_num) {
         }
 
         if (filter_passed) {
+            if (opt_line_prefix) {
+                printf("%s:", opt_line_prefix);
+            }
             if (opt_n_line_numbers) {
                 printf("%6d:", line_num);
             }
@@ -97,39 +112,130 @@ static int process_line(char *line, const char *pattern, int line_num) {
 
 
 
+/*
+ * Reads fd with plain read() and hands each complete line to process_line,
+ * so a pipe or file feeds the scan without a stdio buffer in between. The
+ * buffer grows for lines longer than it.
+ */
+static void grep_fd(int fd, const char *name, const char *pattern) {
+    size_t cap = GREP_READ_SIZE;
+    char *buffer = (char *)malloc(cap + 1);
+    size_t len = 0;
+    int current_line_num = 0;
+    if (buffer == NULL) {
+        fprintf(stderr, "mx grep: out of memory\n");
+        return;
+    }
+    while (1) {
+        if (len == cap) {
+            char *grown = (char *)realloc(buffer, cap * 2 + 1);
+            if (grown == NULL) {
+                fprintf(stderr, "mx grep: %s: line too long\n", name);
+                break;
+            }
+            buffer = grown;
+            cap *= 2;
+        }
+        ssize_t n = read(fd, buffer + len, cap - len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            fprintf(stderr, "mx grep: %s: %s\n", name, strerror(errno));
+            break;
+        }
+        if (n == 0) break;
+        MX_STAT_ADD(MX_STAT_BYTES_READ, n);
+        len += (size_t)n;
+
+        size_t start = 0;
+        char *newline;
+        while ((newline = (char *)memchr(buffer + start, '\n', len - start)) != NULL) {
+            *newline = '\0';
+            current_line_num++;
+            process_line(buffer + start, pattern, current_line_num);
+            start = (size_t)(newline - buffer) + 1;
+        }
+        memmove(buffer, buffer + start, len - start);
+        len -= start;
+    }
+    if (len > 0) {
+        buffer[len] = '\0';
+        current_line_num++;
+        process_line(buffer, pattern, current_line_num);
+    }
+    free(buffer);
+}
+
+static void grep_path(const char *path, const char *pattern) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        perror(path);
+        return;
+    }
+    grep_fd(fd, path, pattern);
+    close(fd);
+}
+
+static void grep_indexed_file(const char *path, void *arg) {
+    opt_line_prefix = path;
+    grep_path(path, (const char *)arg);
+    opt_line_prefix = NULL;
+}
+
+/* Whether a line without any match can pass the -m filter; the index cannot rule such files out. */
+static int filter_accepts_zero(void) {
+    if (opt_s_only_match) return 0;
+    switch (opt_m_filter_type) {
+        case LESS_THAN: return opt_m_filter_value > 0;
+        case LESS_THAN_EQUALS: return 1;
+        case EQUALS: return opt_m_filter_value == 0;
+        default: return 0;
+    }
+}
+
 void print_mgrip_help() {
-    fprintf(stdout, "=================================================================\\n");
-    fprintf(stdout, "Usage: mx grep [OPTIONS] <pattern> [file...]\\n");
-    fprintf(stdout, "Search for PATTERN in each FILE or standard input.\\n\\n");
-    fprintf(stdout, "Options:\\n");
-    fprintf(stdout, "  -s        Show only the matched part of the line (self-print).\\n");
-    fprintf(stdout, "  -n        Print line numbers.\\n");
-    fprintf(stdout, "  -m>N      Filter by more than N matches.\\n");
-    fprintf(stdout, "  -m<N      Filter by less than N matches.\\n");
-    fprintf(stdout, "  -m=N      Filter by exactly N matches.\\n");
-    fprintf(stdout, "  -m>=N     Filter by N or more matches.\\n");
-    fprintf(stdout, "  -m<=N     Filter by N or less matches.\\n");
-    fprintf(stdout, "  -h        Display this help message.\\n");
-    fprintf(stdout, "=========================[MX grep version 0.2]===================\\n");
+    fprintf(stdout, "=================================================================\n");
+    fprintf(stdout, "Usage: mx grep [OPTIONS] <pattern> [file...]\n");
+    fprintf(stdout, "       mx grep [OPTIONS] --index DIR <pattern>\n");
+    fprintf(stdout, "Search for PATTERN in each FILE or standard input.\n\n");
+    fprintf(stdout, "Options:\n");
+    fprintf(stdout, "  -s        Show only the matched part of the line (self-print).\n");
+    fprintf(stdout, "  -n        Print line numbers.\n");
+    fprintf(stdout, "  -m>N      Filter by more than N matches.\n");
+    fprintf(stdout, "  -m<N      Filter by less than N matches.\n");
+    fprintf(stdout, "  -m=N      Filter by exactly N matches.\n");
+    fprintf(stdout, "  -m>=N     Filter by N or more matches.\n");
+    fprintf(stdout, "  -m<=N     Filter by N or less matches.\n");
+    fprintf(stdout, "  -h        Display this help message.\n");
+    fprintf(stdout, "  --build-index DIR  Write a trigram index of DIR to DIR/" MGRIP_INDEX_NAME ".\n");
+    fprintf(stdout, "  --index DIR        Search the files of DIR, reading only those the index allows;\n");
+    fprintf(stdout, "                     without -m only the lines that match are printed.\n");
+    fprintf(stdout, "=========================[MX grep version 0.2]===================\n");
 }
 
+static const struct option mgrip_long_options[] = {
+    { "build-index", required_argument, NULL, 'B' },
+    { "index", required_argument, NULL, 'I' },
+    { "help", no_argument, NULL, 'h' },
+    { NULL, 0, NULL, 0 }
+};
+
 int mgrip_cmd_internal(int argc, char *argv[]) {
-    char line_buffer[MAX_LINE_LEN];
     const char *pattern = NULL;
-    FILE *input_file = NULL;
-    int current_line_num = 0;
+    const char *build_index_dir = NULL;
+    const char *index_dir = NULL;
     int opt;
     long m_val;
     char *endptr;
 
     opt_s_only_match = 0;
     opt_n_line_numbers = 0;
+    opt_line_prefix = NULL;
     opt_m_filter_type = NO_FILTER;
     opt_m_filter_value = 0;
 
     optind = 1;
 
-    while ((opt = getopt(argc, argv, "snm:h")) != -1) {
+    while ((opt = getopt_long(argc, argv, "snm:h", mgrip_long_options, NULL)) != -1) {
         switch (opt) {
             case 's':
                 opt_s_only_match = 1;
@@ -139,13 +245,14 @@ int mgrip_cmd_internal(int argc, char *argv[]) {
                 break;
             case 'm':
                 if (strlen(optarg) < 2) {
-                    fprintf(stderr, "Error: Invalid argument for -m. Expected -m>N, -m<N, etc.\\n");
+                    fprintf(stderr, "Error: Invalid argument for -m. Expected -m>N, -m<N, etc.\n");
                     return EXIT_FAILURE;
                 }
                 char operator = optarg[0];
-                m_val = strtol(optarg + 1, &endptr, 10);
-                if (*endptr != '\\0' || m_val < 0) {
-                    fprintf(stderr, "Error: Invalid numeric value for -m option: '%s'\\n", optarg + 1);
+                int operator_len = ((operator == '>' || operator == '<') && optarg[1] == '=') ? 2 : 1;
+                m_val = strtol(optarg + operator_len, &endptr, 10);
+                if (*endptr != '\0' || m_val < 0) {
+                    fprintf(stderr, "Error: Invalid numeric value for -m option: '%s'\n", optarg + operator_len);
                     return EXIT_FAILURE;
                 }
                 opt_m_filter_value = (int)m_val;
@@ -165,48 +272,60 @@ int mgrip_cmd_internal(int argc, char *argv[]) {
                 } else if (operator == '=') {
                     opt_m_filter_type = EQUALS;
                 } else {
-                    fprintf(stderr, "Error: Invalid operator for -m option. Use '>', '<', '=', '>=', '<='.\\n");
+                    fprintf(stderr, "Error: Invalid operator for -m option. Use '>', '<', '=', '>=', '<='.\n");
                     return EXIT_FAILURE;
                 }
                 break;
+            case 'B':
+                build_index_dir = optarg;
+                break;
+            case 'I':
+                index_dir = optarg;
+                break;
             case 'h':
                 print_mgrip_help();
                 return EXIT_SUCCESS;
             case '?':
-                fprintf(stderr, "Usage: mx grep [-s] [-n] [-m>N|-m<N|-m=N|-m>=N|-m<=N] <pattern> [file...]\\n");
+                fprintf(stderr, "Usage: mx grep [-s] [-n] [-m>N|-m<N|-m=N|-m>=N|-m<=N] [--index DIR] <pattern> [file...]\n");
                 return EXIT_FAILURE;
         }
     }
 
+    if (build_index_dir) {
+        if (optind != argc || index_dir) {
+            fprintf(stderr, "Usage: mx grep --build-index DIR\n");
+            return EXIT_FAILURE;
+        }
+        return mgrip_build_index(build_index_dir) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
     if (optind < argc) {
         pattern = argv[optind];
         optind++;
     } else {
-        fprintf(stderr, "Error: Pattern missing.\\n");
-        fprintf(stderr, "Usage: mx grep [-s] [-n] [-m>N|-m<N|-m=N|-m>=N|-m<=N] <pattern> [file...]\\n");
+        fprintf(stderr, "Error: Pattern missing.\n");
+        fprintf(stderr, "Usage: mx grep [-s] [-n] [-m>N|-m<N|-m=N|-m>=N|-m<=N] [--index DIR] <pattern> [file...]\n");
         return EXIT_FAILURE;
     }
 
-    if (optind == argc) {
-        while (fgets(line_buffer, sizeof(line_buffer), stdin) != NULL) {
-            current_line_num++;
-            process_line(line_buffer, pattern, current_line_num);
+    if (index_dir) {
+        if (optind != argc) {
+            fprintf(stderr, "Error: --index takes no file arguments.\n");
+            return EXIT_FAILURE;
+        }
+        /* --index reports files that contain the pattern, so without -m it prints only matching lines. */
+        if (opt_m_filter_type == NO_FILTER) {
+            opt_m_filter_type = GREATER_THAN;
+            opt_m_filter_value = 0;
+        }
+        if (mgrip_index_search(index_dir, pattern, filter_accepts_zero(), grep_indexed_file, (void *)pattern) != 0) {
+            return EXIT_FAILURE;
         }
+    } else if (optind == argc) {
+        grep_fd(STDIN_FILENO, "(standard input)", pattern);
     } else {
-
         for (int i = optind; i < argc; ++i) {
-            input_file = fopen(argv[i], "r");
-            if (!input_file) {
-                perror(argv[i]);
-                continue;
-            }
-
-            current_line_num = 0;
-            while (fgets(line_buffer, sizeof(line_buffer), input_file) != NULL) {
-                current_line_num++;
-                process_line(line_buffer, pattern, current_line_num);
-            }
-            fclose(input_file);
+            grep_path(argv[i], pattern);
         }
     }
 
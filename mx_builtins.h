@@ -0,0 +1,15 @@
+#ifndef MX_BUILTINS_H
+#define MX_BUILTINS_H
+
+typedef int (*mx_builtin_fn)(int argc, char *argv[]);
+
+struct mx_builtin {
+    const char *name;
+    mx_builtin_fn fn;
+};
+
+mx_builtin_fn mx_find_builtin(const char *name);
+int mx_call_builtin(const char *name, mx_builtin_fn fn, int argc, char *argv[]);
+int mx_run_argv(int argc, char *argv[]);
+
+#endif
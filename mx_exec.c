@@ -0,0 +1,236 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <spawn.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include "mx_exec.h"
+
+extern char **environ;
+
+#define MX_HASH_BUCKETS 64
+#define MX_DEFAULT_PATH "/usr/local/bin:/usr/bin:/bin"
+
+struct mx_hash_entry {
+    char *name;
+    char *path;
+    unsigned int hits;
+    struct mx_hash_entry *next;
+};
+
+static struct mx_hash_entry *hash_table[MX_HASH_BUCKETS];
+/* PATH value the table was filled from; any change flushes it. */
+static char *hashed_path_env = NULL;
+/* Last hit in a relative PATH entry; never hashed, since it depends on the working directory. */
+static char *relative_hit = NULL;
+
+static unsigned int hash_name(const char *name) {
+    unsigned int h = 2166136261u;
+    while (*name) {
+        h ^= (unsigned char)*name++;
+        h *= 16777619u;
+    }
+    return h % MX_HASH_BUCKETS;
+}
+
+static void hash_clear(void) {
+    for (int i = 0; i < MX_HASH_BUCKETS; ++i) {
+        struct mx_hash_entry *entry = hash_table[i];
+        while (entry) {
+            struct mx_hash_entry *next = entry->next;
+            free(entry->name);
+            free(entry->path);
+            free(entry);
+            entry = next;
+        }
+        hash_table[i] = NULL;
+    }
+}
+
+static const char *current_path_env(void) {
+    const char *path_env = getenv("PATH");
+    if (path_env == NULL) path_env = MX_DEFAULT_PATH;
+    if (hashed_path_env == NULL || strcmp(hashed_path_env, path_env) != 0) {
+        hash_clear();
+        free(hashed_path_env);
+        hashed_path_env = strdup(path_env);
+    }
+    return path_env;
+}
+
+static struct mx_hash_entry **hash_find(const char *name) {
+    struct mx_hash_entry **link = &hash_table[hash_name(name)];
+    while (*link && strcmp((*link)->name, name) != 0) {
+        link = &(*link)->next;
+    }
+    return link;
+}
+
+static void hash_forget(const char *name) {
+    struct mx_hash_entry **link = hash_find(name);
+    struct mx_hash_entry *entry = *link;
+    if (entry == NULL) return;
+    *link = entry->next;
+    free(entry->name);
+    free(entry->path);
+    free(entry);
+}
+
+static char *search_path(const char *name, const char *path_env, int *relative) {
+    size_t name_len = strlen(name);
+    const char *dir = path_env;
+    while (1) {
+        const char *end = strchr(dir, ':');
+        size_t dir_len = end ? (size_t)(end - dir) : strlen(dir);
+        char *full = (char *)malloc(dir_len + name_len + 3);
+        if (full == NULL) return NULL;
+        if (dir_len == 0) {
+            full[0] = '.';
+            dir_len = 1;
+        } else {
+            memcpy(full, dir, dir_len);
+        }
+        full[dir_len] = '/';
+        memcpy(full + dir_len + 1, name, name_len + 1);
+        struct stat st;
+        if (access(full, X_OK) == 0 && stat(full, &st) == 0 && S_ISREG(st.st_mode)) {
+            *relative = full[0] != '/';
+            return full;
+        }
+        free(full);
+        if (end == NULL) break;
+        dir = end + 1;
+    }
+    return NULL;
+}
+
+const char *mx_lookup_command(const char *name) {
+    if (strchr(name, '/') != NULL) return name;
+    const char *path_env = current_path_env();
+    struct mx_hash_entry **link = hash_find(name);
+    if (*link) {
+        (*link)->hits++;
+        return (*link)->path;
+    }
+    int relative;
+    char *full = search_path(name, path_env, &relative);
+    if (full == NULL) return NULL;
+    if (relative) {
+        free(relative_hit);
+        relative_hit = full;
+        return full;
+    }
+    struct mx_hash_entry *entry = (struct mx_hash_entry *)malloc(sizeof(*entry));
+    char *name_copy = strdup(name);
+    if (entry == NULL || name_copy == NULL) {
+        free(entry);
+        free(name_copy);
+        free(full);
+        return NULL;
+    }
+    entry->name = name_copy;
+    entry->path = full;
+    entry->hits = 1;
+    entry->next = NULL;
+    *link = entry;
+    return full;
+}
+
+static int spawn_path(pid_t *pid, const char *path, char *argv[], int in_fd, int out_fd) {
+    posix_spawnattr_t attr;
+    posix_spawn_file_actions_t actions;
+    posix_spawnattr_init(&attr);
+#ifdef POSIX_SPAWN_USEVFORK
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_USEVFORK);
+#endif
+    posix_spawn_file_actions_init(&actions);
+    if (in_fd >= 0 && in_fd != STDIN_FILENO) {
+        posix_spawn_file_actions_adddup2(&actions, in_fd, STDIN_FILENO);
+    }
+    if (out_fd >= 0 && out_fd != STDOUT_FILENO) {
+        posix_spawn_file_actions_adddup2(&actions, out_fd, STDOUT_FILENO);
+    }
+    int ret = posix_spawn(pid, path, &actions, &attr, argv, environ);
+    posix_spawn_file_actions_destroy(&actions);
+    posix_spawnattr_destroy(&attr);
+    return ret;
+}
+
+int mx_spawn_command(char *argv[], int in_fd, int out_fd, pid_t *pid) {
+    const char *path = mx_lookup_command(argv[0]);
+    if (path == NULL) {
+        fprintf(stderr, "mx: %s: command not found\n", argv[0]);
+        return 127;
+    }
+    fflush(stdout);
+    int ret = spawn_path(pid, path, argv, in_fd, out_fd);
+    if (ret == ENOENT && path != argv[0]) {
+        /* The cached binary went away; search PATH again once. */
+        hash_forget(argv[0]);
+        path = mx_lookup_command(argv[0]);
+        if (path == NULL) {
+            fprintf(stderr, "mx: %s: command not found\n", argv[0]);
+            return 127;
+        }
+        ret = spawn_path(pid, path, argv, in_fd, out_fd);
+    }
+    if (ret != 0) {
+        fprintf(stderr, "mx: %s: %s\n", argv[0], strerror(ret));
+        return ret == ENOENT ? 127 : 126;
+    }
+    return 0;
+}
+
+int mx_wait_command(pid_t pid) {
+    int wstatus;
+    while (waitpid(pid, &wstatus, 0) < 0) {
+        if (errno != EINTR) {
+            perror("mx: waitpid");
+            return 1;
+        }
+    }
+    if (WIFEXITED(wstatus)) return WEXITSTATUS(wstatus);
+    if (WIFSIGNALED(wstatus)) return 128 + WTERMSIG(wstatus);
+    return 1;
+}
+
+int mx_exec_external(int argc, char *argv[]) {
+    (void)argc;
+    pid_t pid;
+    int ret = mx_spawn_command(argv, -1, -1, &pid);
+    if (ret != 0) return ret;
+    return mx_wait_command(pid);
+}
+
+int mx_hash(int argc, char *argv[]) {
+    if (argc > 1 && strcmp(argv[1], "-r") == 0) {
+        hash_clear();
+        return 0;
+    }
+    if (argc > 1) {
+        int status = 0;
+        for (int i = 1; i < argc; ++i) {
+            if (mx_lookup_command(argv[i]) == NULL) {
+                fprintf(stderr, "mx hash: %s: not found\n", argv[i]);
+                status = 1;
+            }
+        }
+        return status;
+    }
+    current_path_env();
+    int empty = 1;
+    for (int i = 0; i < MX_HASH_BUCKETS; ++i) {
+        for (struct mx_hash_entry *entry = hash_table[i]; entry; entry = entry->next) {
+            if (empty) {
+                printf("hits\tcommand\n");
+                empty = 0;
+            }
+            printf("%4u\t%s\n", entry->hits, entry->path);
+        }
+    }
+    if (empty) printf("mx hash: hash table empty\n");
+    return 0;
+}
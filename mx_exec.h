@@ -0,0 +1,12 @@
+#ifndef MX_EXEC_H
+#define MX_EXEC_H
+
+#include <sys/types.h>
+
+const char *mx_lookup_command(const char *name);
+int mx_spawn_command(char *argv[], int in_fd, int out_fd, pid_t *pid);
+int mx_wait_command(pid_t pid);
+int mx_exec_external(int argc, char *argv[]);
+int mx_hash(int argc, char *argv[]);
+
+#endif
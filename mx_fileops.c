@@ -0,0 +1,767 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <stdatomic.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <sys/ioctl.h>
+#ifdef __linux__
+#include <linux/fs.h>
+#endif
+#include "mx_fileops.h"
+#include "mx_pool.h"
+#include "mx_stats.h"
+
+/* Queue depth per worker before tree walkers stop fanning out and recurse inline. */
+#define MX_WALK_BACKLOG_PER_THREAD 4
+#define MX_COPY_BUFFER_SIZE (1 << 20)
+#define MX_COPY_CHUNK (1 << 30)
+#define MX_SPLICE_CHUNK (1 << 20)
+
+/*
+ * Tree walks hold a descriptor per directory in flight, so the soft limit
+ * is lifted for the walk only; restore_fd_limit puts back the saved value
+ * so the shell and later commands keep the limit they started with.
+ */
+static int raise_fd_limit(struct rlimit *saved) {
+    if (getrlimit(RLIMIT_NOFILE, saved) != 0 || saved->rlim_cur >= saved->rlim_max) return 0;
+    struct rlimit rl = *saved;
+    rl.rlim_cur = rl.rlim_max;
+    return setrlimit(RLIMIT_NOFILE, &rl) == 0;
+}
+
+static void restore_fd_limit(const struct rlimit *saved) {
+    setrlimit(RLIMIT_NOFILE, saved);
+}
+
+static char *path_join(const char *dir, const char *name) {
+    size_t dir_len = strlen(dir);
+    size_t name_len = strlen(name);
+    char *path = (char *)malloc(dir_len + name_len + 2);
+    if (path == NULL) return NULL;
+    memcpy(path, dir, dir_len);
+    size_t pos = dir_len;
+    if (dir_len > 0 && dir[dir_len - 1] != '/') path[pos++] = '/';
+    memcpy(path + pos, name, name_len + 1);
+    return path;
+}
+
+static int is_dot_or_dotdot(const char *name) {
+    return name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'));
+}
+
+static int entry_is_dir(int dir_fd, struct dirent *entry) {
+    if (entry->d_type != DT_UNKNOWN) {
+        return entry->d_type == DT_DIR;
+    }
+    struct stat st;
+    if (fstatat(dir_fd, entry->d_name, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+        return 0;
+    }
+    return S_ISDIR(st.st_mode);
+}
+
+struct rm_ctx {
+    mx_pool *pool;
+    struct rlimit fd_limit;
+    int fd_limit_raised;
+    int force;
+    atomic_int failed;
+};
+
+struct rm_dir {
+    struct rm_ctx *ctx;
+    struct rm_dir *parent;
+    int fd;
+    char *path;
+    const char *name;
+    atomic_int pending;
+};
+
+static void rm_report(struct rm_ctx *ctx, const char *dir, const char *name, int err) {
+    if (ctx->force && err == ENOENT) return;
+    atomic_store(&ctx->failed, 1);
+    if (name != NULL) {
+        fprintf(stderr, "mx rm: cannot remove '%s/%s': %s\n", dir, name, strerror(err));
+    } else {
+        fprintf(stderr, "mx rm: cannot remove '%s': %s\n", dir, strerror(err));
+    }
+}
+
+static void rm_dir_task(void *arg);
+
+static void rm_dir_release(struct rm_dir *node) {
+    while (node != NULL && atomic_fetch_sub(&node->pending, 1) == 1) {
+        struct rm_dir *parent = node->parent;
+        close(node->fd);
+        int parent_fd = parent ? parent->fd : AT_FDCWD;
+        if (unlinkat(parent_fd, node->name, AT_REMOVEDIR) != 0) {
+            rm_report(node->ctx, node->path, NULL, errno);
+        }
+        free(node->path);
+        free(node);
+        node = parent;
+    }
+}
+
+/* Removes everything below fd depth-first on the calling thread; closes fd. */
+static void rm_tree_inline(struct rm_ctx *ctx, int fd, const char *path) {
+    int scan_fd = dup(fd);
+    DIR *d = scan_fd >= 0 ? fdopendir(scan_fd) : NULL;
+    if (d == NULL) {
+        rm_report(ctx, path, NULL, errno);
+        if (scan_fd >= 0) close(scan_fd);
+        close(fd);
+        return;
+    }
+    struct dirent *entry;
+    while ((entry = readdir(d)) != NULL) {
+        if (is_dot_or_dotdot(entry->d_name)) continue;
+        if (!entry_is_dir(fd, entry)) {
+            if (unlinkat(fd, entry->d_name, 0) != 0) {
+                rm_report(ctx, path, entry->d_name, errno);
+            }
+            continue;
+        }
+        int child_fd = openat(fd, entry->d_name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+        if (child_fd < 0) {
+            rm_report(ctx, path, entry->d_name, errno);
+            continue;
+        }
+        char *child_path = path_join(path, entry->d_name);
+        rm_tree_inline(ctx, child_fd, child_path ? child_path : entry->d_name);
+        free(child_path);
+        if (unlinkat(fd, entry->d_name, AT_REMOVEDIR) != 0) {
+            rm_report(ctx, path, entry->d_name, errno);
+        }
+    }
+    closedir(d);
+    close(fd);
+}
+
+static void rm_dir_task(void *arg) {
+    struct rm_dir *node = (struct rm_dir *)arg;
+    struct rm_ctx *ctx = node->ctx;
+    size_t fan_out_limit = (size_t)mx_pool_threads(ctx->pool) * MX_WALK_BACKLOG_PER_THREAD;
+
+    int scan_fd = dup(node->fd);
+    DIR *d = scan_fd >= 0 ? fdopendir(scan_fd) : NULL;
+    if (d == NULL) {
+        rm_report(ctx, node->path, NULL, errno);
+        if (scan_fd >= 0) close(scan_fd);
+        rm_dir_release(node);
+        return;
+    }
+    struct dirent *entry;
+    while ((entry = readdir(d)) != NULL) {
+        if (is_dot_or_dotdot(entry->d_name)) continue;
+        if (!entry_is_dir(node->fd, entry)) {
+            if (unlinkat(node->fd, entry->d_name, 0) != 0) {
+                rm_report(ctx, node->path, entry->d_name, errno);
+            }
+            continue;
+        }
+        int child_fd = openat(node->fd, entry->d_name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+        if (child_fd < 0) {
+            rm_report(ctx, node->path, entry->d_name, errno);
+            continue;
+        }
+        char *child_path = path_join(node->path, entry->d_name);
+        struct rm_dir *child = NULL;
+        if (child_path != NULL && mx_pool_backlog(ctx->pool) < fan_out_limit) {
+            child = (struct rm_dir *)malloc(sizeof(*child));
+        }
+        if (child == NULL) {
+            rm_tree_inline(ctx, child_fd, child_path ? child_path : entry->d_name);
+            free(child_path);
+            if (unlinkat(node->fd, entry->d_name, AT_REMOVEDIR) != 0) {
+                rm_report(ctx, node->path, entry->d_name, errno);
+            }
+            continue;
+        }
+        child->ctx = ctx;
+        child->parent = node;
+        child->fd = child_fd;
+        child->path = child_path;
+        child->name = child_path + strlen(child_path) - strlen(entry->d_name);
+        atomic_init(&child->pending, 1);
+        atomic_fetch_add(&node->pending, 1);
+        if (mx_pool_submit(ctx->pool, rm_dir_task, child) != 0) {
+            rm_dir_task(child);
+        }
+    }
+    closedir(d);
+    rm_dir_release(node);
+}
+
+static int rm_operand(struct rm_ctx *ctx, const char *path, int recursive) {
+    struct stat st;
+    if (fstatat(AT_FDCWD, path, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+        if (ctx->force && errno == ENOENT) return 0;
+        fprintf(stderr, "mx rm: cannot remove '%s': %s\n", path, strerror(errno));
+        return 1;
+    }
+    if (!S_ISDIR(st.st_mode)) {
+        if (unlinkat(AT_FDCWD, path, 0) != 0) {
+            fprintf(stderr, "mx rm: cannot remove '%s': %s\n", path, strerror(errno));
+            return 1;
+        }
+        return 0;
+    }
+    if (!recursive) {
+        fprintf(stderr, "mx rm: cannot remove '%s': Is a directory\n", path);
+        return 1;
+    }
+    const char *base = strrchr(path, '/');
+    base = base ? base + 1 : path;
+    if (is_dot_or_dotdot(base)) {
+        fprintf(stderr, "mx rm: refusing to remove '.' or '..' directory: skipping '%s'\n", path);
+        return 1;
+    }
+    if (ctx->pool == NULL) {
+        ctx->fd_limit_raised = raise_fd_limit(&ctx->fd_limit);
+        ctx->pool = mx_pool_create(0);
+        if (ctx->pool == NULL) {
+            fprintf(stderr, "mx rm: failed to start worker threads\n");
+            return 1;
+        }
+    }
+    struct rm_dir *root = (struct rm_dir *)malloc(sizeof(*root));
+    char *root_path = strdup(path);
+    int fd = open(path, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    if (root == NULL || root_path == NULL || fd < 0) {
+        fprintf(stderr, "mx rm: cannot remove '%s': %s\n", path, strerror(fd < 0 ? errno : ENOMEM));
+        if (fd >= 0) close(fd);
+        free(root_path);
+        free(root);
+        return 1;
+    }
+    root->ctx = ctx;
+    root->parent = NULL;
+    root->fd = fd;
+    root->path = root_path;
+    root->name = root_path;
+    atomic_init(&root->pending, 1);
+    if (mx_pool_submit(ctx->pool, rm_dir_task, root) != 0) {
+        rm_dir_task(root);
+    }
+    return 0;
+}
+
+int mx_rm(int argc, char *argv[]) {
+    int recursive = 0;
+    int force = 0;
+    int i = 1;
+    for (; i < argc && argv[i][0] == '-' && argv[i][1] != '\0'; ++i) {
+        if (strcmp(argv[i], "--") == 0) {
+            i++;
+            break;
+        }
+        for (const char *opt = argv[i] + 1; *opt; ++opt) {
+            if (*opt == 'r' || *opt == 'R') {
+                recursive = 1;
+            } else if (*opt == 'f') {
+                force = 1;
+            } else {
+                fprintf(stderr, "mx rm: invalid option -- '%c'\n", *opt);
+                fprintf(stderr, "Usage: mx rm [-r] [-f] <path> [path...]\n");
+                return 1;
+            }
+        }
+    }
+    if (i >= argc) {
+        if (force) return 0;
+        fprintf(stderr, "mx rm: missing operand\n");
+        return 1;
+    }
+
+    struct rm_ctx ctx;
+    ctx.pool = NULL;
+    ctx.fd_limit_raised = 0;
+    ctx.force = force;
+    atomic_init(&ctx.failed, 0);
+
+    int status = 0;
+    for (; i < argc; ++i) {
+        if (rm_operand(&ctx, argv[i], recursive) != 0) {
+            status = 1;
+        }
+    }
+    if (ctx.pool != NULL) {
+        mx_pool_wait(ctx.pool);
+        mx_pool_destroy(ctx.pool);
+    }
+    if (ctx.fd_limit_raised) restore_fd_limit(&ctx.fd_limit);
+    if (atomic_load(&ctx.failed)) status = 1;
+    return status;
+}
+
+static int copy_fd_buffered(int in_fd, int out_fd) {
+    char *buffer = (char *)malloc(MX_COPY_BUFFER_SIZE);
+    if (buffer == NULL) {
+        errno = ENOMEM;
+        return -1;
+    }
+    ssize_t n;
+    while ((n = read(in_fd, buffer, MX_COPY_BUFFER_SIZE)) != 0) {
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            free(buffer);
+            return -1;
+        }
+        MX_STAT_ADD(MX_STAT_BYTES_READ, n);
+        ssize_t off = 0;
+        while (off < n) {
+            ssize_t w = write(out_fd, buffer + off, (size_t)(n - off));
+            if (w < 0) {
+                if (errno == EINTR) continue;
+                free(buffer);
+                return -1;
+            }
+            MX_STAT_ADD(MX_STAT_BYTES_WRITTEN, w);
+            off += w;
+        }
+    }
+    free(buffer);
+    return 0;
+}
+
+/*
+ * Appends from the current offsets: in-kernel copy first, then read/write.
+ * Pseudo files (/proc, /sys) report a size copy_file_range does not honour
+ * and can make it return 0 straight away, so an immediate 0 is confirmed
+ * with read() instead of being taken as an empty source.
+ */
+static int copy_fd_stream(int in_fd, int out_fd) {
+    ssize_t n;
+    int copied = 0;
+    while ((n = copy_file_range(in_fd, NULL, out_fd, NULL, MX_COPY_CHUNK, 0)) > 0) {
+        MX_STAT_ADD(MX_STAT_BYTES_READ, n);
+        MX_STAT_ADD(MX_STAT_BYTES_WRITTEN, n);
+        copied = 1;
+    }
+    if (n == 0) return copied ? 0 : copy_fd_buffered(in_fd, out_fd);
+    if (errno != ENOSYS && errno != EXDEV && errno != EINVAL &&
+        errno != EOPNOTSUPP && errno != EPERM && errno != EBADF) {
+        return -1;
+    }
+    return copy_fd_buffered(in_fd, out_fd);
+}
+
+/* Reflink when the filesystem allows it; out_fd must be a fresh, empty file. */
+static int copy_fd(int in_fd, int out_fd) {
+#ifdef FICLONE
+    if (ioctl(out_fd, FICLONE, in_fd) == 0) return 0;
+#endif
+    return copy_fd_stream(in_fd, out_fd);
+}
+
+static int copy_file_at(int src_dir, const char *src_name, int dst_dir, const char *dst_name, mode_t mode) {
+    int in_fd = openat(src_dir, src_name, O_RDONLY | O_CLOEXEC);
+    if (in_fd < 0) return -1;
+    int out_fd = openat(dst_dir, dst_name, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, mode & 0777);
+    if (out_fd < 0) {
+        int err = errno;
+        close(in_fd);
+        errno = err;
+        return -1;
+    }
+    int ret = copy_fd(in_fd, out_fd);
+    int err = errno;
+    if (ret == 0 && fchmod(out_fd, mode & 07777) != 0) {
+        ret = -1;
+        err = errno;
+    }
+    close(in_fd);
+    if (close(out_fd) != 0 && ret == 0) {
+        ret = -1;
+        err = errno;
+    }
+    errno = err;
+    return ret;
+}
+
+static int copy_symlink_at(int src_dir, const char *src_name, int dst_dir, const char *dst_name, off_t size_hint) {
+    size_t cap = size_hint > 0 ? (size_t)size_hint + 1 : 256;
+    char *target = NULL;
+    ssize_t len;
+    while (1) {
+        char *grown = (char *)realloc(target, cap);
+        if (grown == NULL) {
+            free(target);
+            errno = ENOMEM;
+            return -1;
+        }
+        target = grown;
+        len = readlinkat(src_dir, src_name, target, cap);
+        if (len < 0) {
+            free(target);
+            return -1;
+        }
+        if ((size_t)len < cap) break;
+        cap *= 2;
+    }
+    target[len] = '\0';
+    unlinkat(dst_dir, dst_name, 0);
+    int ret = symlinkat(target, dst_dir, dst_name);
+    free(target);
+    return ret;
+}
+
+struct cp_ctx {
+    mx_pool *pool;
+    struct rlimit fd_limit;
+    int fd_limit_raised;
+    atomic_int failed;
+};
+
+struct cp_dir {
+    struct cp_ctx *ctx;
+    int src_fd;
+    int dst_fd;
+    char *src_path;
+    char *dst_path;
+    mode_t mode;
+    int created;
+    dev_t dst_root_dev;
+    ino_t dst_root_ino;
+    atomic_int refs;
+};
+
+struct cp_file {
+    struct cp_dir *dir;
+    mode_t mode;
+    char name[];
+};
+
+static void cp_report(struct cp_ctx *ctx, const char *dir, const char *name, int err) {
+    atomic_store(&ctx->failed, 1);
+    if (name != NULL) {
+        fprintf(stderr, "mx cp: cannot copy '%s/%s': %s\n", dir, name, strerror(err));
+    } else {
+        fprintf(stderr, "mx cp: cannot copy '%s': %s\n", dir, strerror(err));
+    }
+}
+
+/*
+ * The directory mode is applied last so read-only directories can still be
+ * filled; a directory that already existed keeps its own mode, as in cp without -p.
+ */
+static void cp_dir_release(struct cp_dir *dir) {
+    if (atomic_fetch_sub(&dir->refs, 1) != 1) return;
+    if (dir->created && fchmod(dir->dst_fd, dir->mode & 07777) != 0) {
+        cp_report(dir->ctx, dir->dst_path, NULL, errno);
+    }
+    close(dir->src_fd);
+    close(dir->dst_fd);
+    free(dir->src_path);
+    free(dir->dst_path);
+    free(dir);
+}
+
+static void cp_file_task(void *arg) {
+    struct cp_file *file = (struct cp_file *)arg;
+    struct cp_dir *dir = file->dir;
+    if (copy_file_at(dir->src_fd, file->name, dir->dst_fd, file->name, file->mode) != 0) {
+        cp_report(dir->ctx, dir->src_path, file->name, errno);
+    }
+    free(file);
+    cp_dir_release(dir);
+}
+
+/* follow is set for command-line operands only; entries met during the walk are never followed. */
+static struct cp_dir *cp_dir_open(struct cp_ctx *ctx, int src_parent, const char *src_name, int follow,
+                                  int dst_parent, const char *dst_name, mode_t mode,
+                                  char *src_path, char *dst_path) {
+    /* The source is opened first so an unreadable operand leaves no empty destination behind. */
+    int src_flags = O_RDONLY | O_DIRECTORY | O_CLOEXEC | (follow ? 0 : O_NOFOLLOW);
+    int src_fd = openat(src_parent, src_name, src_flags);
+    int dst_fd = -1;
+    int created = 0;
+    int err = errno;
+    if (src_fd >= 0) {
+        created = mkdirat(dst_parent, dst_name, S_IRWXU) == 0;
+        if (created || errno == EEXIST) {
+            dst_fd = openat(dst_parent, dst_name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        }
+        err = errno;
+    }
+    struct cp_dir *dir = dst_fd >= 0 ? (struct cp_dir *)malloc(sizeof(*dir)) : NULL;
+    if (dir == NULL) {
+        cp_report(ctx, src_path, NULL, dst_fd >= 0 ? ENOMEM : err);
+        if (src_fd >= 0) close(src_fd);
+        if (dst_fd >= 0) close(dst_fd);
+        free(src_path);
+        free(dst_path);
+        return NULL;
+    }
+    dir->ctx = ctx;
+    dir->src_fd = src_fd;
+    dir->dst_fd = dst_fd;
+    dir->src_path = src_path;
+    dir->dst_path = dst_path;
+    dir->mode = mode;
+    dir->created = created;
+    dir->dst_root_dev = 0;
+    dir->dst_root_ino = 0;
+    atomic_init(&dir->refs, 1);
+    return dir;
+}
+
+static void cp_dir_task(void *arg) {
+    struct cp_dir *dir = (struct cp_dir *)arg;
+    struct cp_ctx *ctx = dir->ctx;
+    size_t fan_out_limit = (size_t)mx_pool_threads(ctx->pool) * MX_WALK_BACKLOG_PER_THREAD;
+
+    int scan_fd = dup(dir->src_fd);
+    DIR *d = scan_fd >= 0 ? fdopendir(scan_fd) : NULL;
+    if (d == NULL) {
+        cp_report(ctx, dir->src_path, NULL, errno);
+        if (scan_fd >= 0) close(scan_fd);
+        cp_dir_release(dir);
+        return;
+    }
+    struct dirent *entry;
+    while ((entry = readdir(d)) != NULL) {
+        const char *name = entry->d_name;
+        if (is_dot_or_dotdot(name)) continue;
+        struct stat st;
+        if (fstatat(dir->src_fd, name, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+            cp_report(ctx, dir->src_path, name, errno);
+            continue;
+        }
+        if (S_ISDIR(st.st_mode)) {
+            if (st.st_dev == dir->dst_root_dev && st.st_ino == dir->dst_root_ino) {
+                fprintf(stderr, "mx cp: cannot copy a directory, '%s', into itself\n", dir->src_path);
+                atomic_store(&ctx->failed, 1);
+                continue;
+            }
+            char *src_path = path_join(dir->src_path, name);
+            char *dst_path = path_join(dir->dst_path, name);
+            if (src_path == NULL || dst_path == NULL) {
+                free(src_path);
+                free(dst_path);
+                cp_report(ctx, dir->src_path, name, ENOMEM);
+                continue;
+            }
+            struct cp_dir *child = cp_dir_open(ctx, dir->src_fd, name, 0, dir->dst_fd, name,
+                                               st.st_mode, src_path, dst_path);
+            if (child == NULL) continue;
+            child->dst_root_dev = dir->dst_root_dev;
+            child->dst_root_ino = dir->dst_root_ino;
+            if (mx_pool_backlog(ctx->pool) >= fan_out_limit ||
+                mx_pool_submit(ctx->pool, cp_dir_task, child) != 0) {
+                cp_dir_task(child);
+            }
+        } else if (S_ISREG(st.st_mode)) {
+            struct cp_file *file = NULL;
+            if (mx_pool_backlog(ctx->pool) < fan_out_limit) {
+                file = (struct cp_file *)malloc(sizeof(*file) + strlen(name) + 1);
+            }
+            if (file == NULL) {
+                if (copy_file_at(dir->src_fd, name, dir->dst_fd, name, st.st_mode) != 0) {
+                    cp_report(ctx, dir->src_path, name, errno);
+                }
+                continue;
+            }
+            file->dir = dir;
+            file->mode = st.st_mode;
+            strcpy(file->name, name);
+            atomic_fetch_add(&dir->refs, 1);
+            if (mx_pool_submit(ctx->pool, cp_file_task, file) != 0) {
+                cp_file_task(file);
+            }
+        } else if (S_ISLNK(st.st_mode)) {
+            if (copy_symlink_at(dir->src_fd, name, dir->dst_fd, name, st.st_size) != 0) {
+                cp_report(ctx, dir->src_path, name, errno);
+            }
+        } else {
+            fprintf(stderr, "mx cp: skipping special file '%s/%s'\n", dir->src_path, name);
+        }
+    }
+    closedir(d);
+    cp_dir_release(dir);
+}
+
+static char *cp_target_path(const char *dst, int dst_is_dir, const char *src) {
+    if (!dst_is_dir) return strdup(dst);
+    size_t len = strlen(src);
+    while (len > 1 && src[len - 1] == '/') len--;
+    size_t start = len;
+    while (start > 0 && src[start - 1] != '/') start--;
+    char *name = strndup(src + start, len - start);
+    if (name == NULL) return NULL;
+    char *path = path_join(dst, name);
+    free(name);
+    return path;
+}
+
+static int cp_operand(struct cp_ctx *ctx, const char *src, const char *dst, int dst_is_dir, int recursive) {
+    struct stat st;
+    if (stat(src, &st) != 0) {
+        fprintf(stderr, "mx cp: cannot stat '%s': %s\n", src, strerror(errno));
+        return 1;
+    }
+    char *target = cp_target_path(dst, dst_is_dir, src);
+    if (target == NULL) {
+        fprintf(stderr, "mx cp: out of memory\n");
+        return 1;
+    }
+    struct stat dst_st;
+    if (stat(target, &dst_st) == 0 && dst_st.st_dev == st.st_dev && dst_st.st_ino == st.st_ino) {
+        fprintf(stderr, "mx cp: '%s' and '%s' are the same file\n", src, target);
+        free(target);
+        return 1;
+    }
+
+    if (!S_ISDIR(st.st_mode)) {
+        int ret = 0;
+        if (copy_file_at(AT_FDCWD, src, AT_FDCWD, target, st.st_mode) != 0) {
+            fprintf(stderr, "mx cp: cannot copy '%s' to '%s': %s\n", src, target, strerror(errno));
+            ret = 1;
+        }
+        free(target);
+        return ret;
+    }
+    if (!recursive) {
+        fprintf(stderr, "mx cp: -r not specified; omitting directory '%s'\n", src);
+        free(target);
+        return 1;
+    }
+    if (ctx->pool == NULL) {
+        ctx->fd_limit_raised = raise_fd_limit(&ctx->fd_limit);
+        ctx->pool = mx_pool_create(0);
+        if (ctx->pool == NULL) {
+            fprintf(stderr, "mx cp: failed to start worker threads\n");
+            free(target);
+            return 1;
+        }
+    }
+    char *src_path = strdup(src);
+    char *dst_path = strdup(target);
+    if (src_path == NULL || dst_path == NULL) {
+        fprintf(stderr, "mx cp: out of memory\n");
+        free(src_path);
+        free(dst_path);
+        free(target);
+        return 1;
+    }
+    struct cp_dir *root = cp_dir_open(ctx, AT_FDCWD, src, 1, AT_FDCWD, target, st.st_mode, src_path, dst_path);
+    free(target);
+    if (root == NULL) return 1;
+    struct stat root_st;
+    if (fstat(root->dst_fd, &root_st) == 0) {
+        root->dst_root_dev = root_st.st_dev;
+        root->dst_root_ino = root_st.st_ino;
+    }
+    if (mx_pool_submit(ctx->pool, cp_dir_task, root) != 0) {
+        cp_dir_task(root);
+    }
+    return 0;
+}
+
+int mx_cp(int argc, char *argv[]) {
+    int recursive = 0;
+    int i = 1;
+    for (; i < argc && argv[i][0] == '-' && argv[i][1] != '\0'; ++i) {
+        if (strcmp(argv[i], "--") == 0) {
+            i++;
+            break;
+        }
+        for (const char *opt = argv[i] + 1; *opt; ++opt) {
+            if (*opt == 'r' || *opt == 'R') {
+                recursive = 1;
+            } else {
+                fprintf(stderr, "mx cp: invalid option -- '%c'\n", *opt);
+                fprintf(stderr, "Usage: mx cp [-r] <source> <dest>\n");
+                fprintf(stderr, "       mx cp [-r] <source>... <directory>\n");
+                return 1;
+            }
+        }
+    }
+    if (argc - i < 2) {
+        fprintf(stderr, "mx cp: missing file operand\n");
+        return 1;
+    }
+    const char *dst = argv[argc - 1];
+    struct stat dst_st;
+    int dst_is_dir = stat(dst, &dst_st) == 0 && S_ISDIR(dst_st.st_mode);
+    if (argc - i > 2 && !dst_is_dir) {
+        fprintf(stderr, "mx cp: target '%s' is not a directory\n", dst);
+        return 1;
+    }
+
+    struct cp_ctx ctx;
+    ctx.pool = NULL;
+    ctx.fd_limit_raised = 0;
+    atomic_init(&ctx.failed, 0);
+
+    int status = 0;
+    for (; i < argc - 1; ++i) {
+        if (cp_operand(&ctx, argv[i], dst, dst_is_dir, recursive) != 0) {
+            status = 1;
+        }
+    }
+    if (ctx.pool != NULL) {
+        mx_pool_wait(ctx.pool);
+        mx_pool_destroy(ctx.pool);
+    }
+    if (ctx.fd_limit_raised) restore_fd_limit(&ctx.fd_limit);
+    if (atomic_load(&ctx.failed)) status = 1;
+    return status;
+}
+
+/* Into a pipe, splice moves page references instead of copying the data. */
+static int cat_fd(int in_fd, int out_fd, int out_is_pipe) {
+    if (out_is_pipe) {
+        ssize_t n;
+        while ((n = splice(in_fd, NULL, out_fd, NULL, MX_SPLICE_CHUNK,
+                                      SPLICE_F_MOVE | SPLICE_F_MORE)) > 0) {
+            MX_STAT_ADD(MX_STAT_BYTES_READ, n);
+            MX_STAT_ADD(MX_STAT_BYTES_WRITTEN, n);
+        }
+        if (n == 0) return 0;
+        if (errno != EINVAL && errno != ENOSYS) return -1;
+    }
+    return copy_fd_stream(in_fd, out_fd);
+}
+
+int mx_cat(int argc, char *argv[]) {
+    fflush(stdout);
+    struct stat out_st;
+    int out_is_pipe = fstat(STDOUT_FILENO, &out_st) == 0 && S_ISFIFO(out_st.st_mode);
+    if (argc < 2) {
+        if (cat_fd(STDIN_FILENO, STDOUT_FILENO, out_is_pipe) != 0) {
+            perror("mx cat");
+            return 1;
+        }
+        return 0;
+    }
+    int status = 0;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "-") == 0) {
+            if (cat_fd(STDIN_FILENO, STDOUT_FILENO, out_is_pipe) != 0) {
+                perror("mx cat");
+                status = 1;
+            }
+            continue;
+        }
+        int fd = open(argv[i], O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            fprintf(stderr, "mx cat: %s: %s\n", argv[i], strerror(errno));
+            status = 1;
+            continue;
+        }
+        if (cat_fd(fd, STDOUT_FILENO, out_is_pipe) != 0) {
+            fprintf(stderr, "mx cat: %s: %s\n", argv[i], strerror(errno));
+            status = 1;
+        }
+        close(fd);
+    }
+    return status;
+}
@@ -0,0 +1,8 @@
+#ifndef MX_FILEOPS_H
+#define MX_FILEOPS_H
+
+int mx_rm(int argc, char *argv[]);
+int mx_cp(int argc, char *argv[]);
+int mx_cat(int argc, char *argv[]);
+
+#endif
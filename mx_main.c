@@ -1,17 +1,26 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <string.h>
 #include <unistd.h>
+#include <fcntl.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <dirent.h>
 #include <libgen.h>
 #include <errno.h>
 #include <stdlib.h>
 #include "mxa_functions.h"
+#include "mxa_dict.h"
+#include "mx_fileops.h"
+#include "mx_exec.h"
+#include "mx_builtins.h"
+#include "mx_pipeline.h"
+#include "mx_stats.h"
+#include "mx_server.h"
 
 extern int mgrip_cmd_internal(int argc, char *argv[]);
 
 #define MAX_COMMAND_LEN 1024
-#define MAX_ARGS 32
 
 int mx_echo(int argc, char *argv[]) {
     for (int i = 1; i < argc; ++i) {
@@ -53,18 +62,6 @@ int mx_mkdir(int argc, char *argv[]){
     return 0;
 }
 
-int mx_rm(int argc, char *argv[]){
-    if(argc < 2){
-        fprintf(stderr,"mx rm: missing operand\n");
-        return 1;
-    }
-    if(unlink(argv[1]) != 0){
-        perror("mx rm");
-        return 1;
-    }
-    return 0;
-}
-
 int mx_rmdir(int argc, char *argv[]){
     if(argc < 2){
         fprintf(stderr,"mx rmdir: missing operand\n");
@@ -77,24 +74,6 @@ int mx_rmdir(int argc, char *argv[]){
     return 0;
 }
 
-int mx_cat(int argc, char *argv[]) {
-    if (argc < 2) {
-        fprintf(stderr, "mx cat: missing operand\n");
-        return 1;
-    }
-    FILE *fp = fopen(argv[1], "r");
-    if (fp == NULL) {
-        perror("mx cat");
-        return 1;
-    }
-    int c;
-    while ((c = fgetc(fp)) != EOF) {
-        putchar(c);
-    }
-    fclose(fp);
-    return 0;
-}
-
 int mx_cd(int argc, char *argv[]) {
     const char *target_dir;
     if (argc < 2 || strcmp(argv[1], "~") == 0) {
@@ -130,20 +109,24 @@ int mx_list(int argc, char *argv[]) {
     printf("  ls\n");
     printf("  mkdir\n");
     printf("  rm\n");
+    printf("  cp\n");
     printf("  rmdir\n");
     printf("  cat\n");
     printf("  cd\n");
     printf("  grep (enhanced by mgrip!)\n");
     printf("  list\n");
+    printf("  hash [-r]\n");
+    printf("  time <command>\n");
     printf("  mxa pack\n");
     printf("  mxa unpack\n");
+    printf("  mxa train\n");
     printf("  exit\n");
     return 0;
 }
 
 int mxa_dispatch_command(int argc, char *argv[]) {
     if (argc < 2) {
-        fprintf(stderr, "Usage: %s <pack|unpack> [arguments...]\n", argv[0]);
+        fprintf(stderr, "Usage: %s <pack|unpack|train> [arguments...]\n", argv[0]);
         return 1;
     }
     const char *sub_command = argv[1];
@@ -151,94 +134,184 @@ int mxa_dispatch_command(int argc, char *argv[]) {
         return mxa_pack_cmd(argc - 1, argv + 1);
     } else if (strcmp(sub_command, "unpack") == 0) {
         return mxa_unpack_cmd(argc - 1, argv + 1);
+    } else if (strcmp(sub_command, "train") == 0) {
+        return mxa_train_cmd(argc - 1, argv + 1);
     } else {
         fprintf(stderr, "Error: Unknown mxa command '%s'\n", sub_command);
         return 1;
     }
 }
 
+/* Kept sorted by name: mx_find_builtin does a binary search over it. */
+static const struct mx_builtin mx_builtins[] = {
+    { "cat", mx_cat },
+    { "cd", mx_cd },
+    { "cp", mx_cp },
+    { "echo", mx_echo },
+    { "exit", mx_exit },
+    { "grep", mgrip_cmd_internal },
+    { "hash", mx_hash },
+    { "list", mx_list },
+    { "ls", mx_ls },
+    { "mkdir", mx_mkdir },
+    { "mxa", mxa_dispatch_command },
+    { "rm", mx_rm },
+    { "rmdir", mx_rmdir },
+    { "time", mx_time },
+};
 
-int main(int argc, char *argv[]){
-    char *prog_name = basename(argv[0]);
-    if (strcmp(prog_name, "grep") == 0) return mgrip_cmd_internal(argc, argv);
-    if (strcmp(prog_name, "mxa") == 0) return mxa_dispatch_command(argc, argv);
-    if (strcmp(prog_name, "cat") == 0) return mx_cat(argc, argv);
-    if (strcmp(prog_name, "ls") == 0) return mx_ls(argc, argv);
-    if (strcmp(prog_name, "cd") == 0) return mx_cd(argc, argv);
-    if (strcmp(prog_name, "echo") == 0) return mx_echo(argc, argv);
-    if (strcmp(prog_name, "mkdir") == 0) return mx_mkdir(argc, argv);
-    if (strcmp(prog_name, "rm") == 0) return mx_rm(argc, argv);
-    if (strcmp(prog_name, "rmdir") == 0) return mx_rmdir(argc, argv);
-    if (strcmp(prog_name, "list") == 0) return mx_list(argc, argv);
-
-    char line[MAX_COMMAND_LEN];
-    char *token;
-    char *args[MAX_ARGS];
+static int builtin_cmp(const void *key, const void *elem) {
+    return strcmp((const char *)key, ((const struct mx_builtin *)elem)->name);
+}
+
+mx_builtin_fn mx_find_builtin(const char *name) {
+    const struct mx_builtin *builtin = bsearch(name, mx_builtins,
+                                               sizeof(mx_builtins) / sizeof(mx_builtins[0]),
+                                               sizeof(mx_builtins[0]), builtin_cmp);
+    return builtin ? builtin->fn : NULL;
+}
+
+int mx_call_builtin(const char *name, mx_builtin_fn fn, int argc, char *argv[]) {
+    /* time reports through its wrapped command, not on its own. */
+    if (!mx_stats_mode || fn == mx_time) return fn(argc, argv);
+    mx_stats_begin();
+    int status = fn(argc, argv);
+    fflush(stdout);
+    mx_stats_report(name, status);
+    return status;
+}
+
+int mx_run_argv(int argc, char *argv[]) {
+    mx_builtin_fn fn = mx_find_builtin(argv[0]);
+    if (fn != NULL) {
+        return mx_call_builtin(argv[0], fn, argc, argv);
+    }
+    return mx_exec_external(argc, argv);
+}
+
+/* Runs every line of an in-memory script; lines are handed to the parser in place. */
+static int run_script(const char *data, size_t len) {
+    int status = 0;
+    size_t pos = 0;
+    while (pos < len) {
+        const char *start = data + pos;
+        const char *end = memchr(start, '\n', len - pos);
+        size_t line_len = end ? (size_t)(end - start) : len - pos;
+        status = mx_run_line(start, line_len);
+        pos += line_len + 1;
+    }
+    return status;
+}
+
+static int run_stream(FILE *fp, int interactive) {
+    char *line = NULL;
+    size_t cap = 0;
+    ssize_t len;
     int status = 0;
 
     while (1) {
-        char cwd[MAX_COMMAND_LEN];
- 
-        if (getcwd(cwd, sizeof(cwd)) != NULL) {
-            printf("mx:%s$ ", cwd);
-        } else {
-            perror("getcwd");
-            printf("mx$ ");
+        if (interactive) {
+            char cwd[MAX_COMMAND_LEN];
+            if (getcwd(cwd, sizeof(cwd)) != NULL) {
+                printf("mx:%s$ ", cwd);
+            } else {
+                perror("getcwd");
+                printf("mx$ ");
+            }
+            fflush(stdout);
         }
-        
-        if (fgets(line, sizeof(line), stdin) == NULL) {
-            printf("\n");
+
+        if ((len = getline(&line, &cap, fp)) < 0) {
+            if (interactive) printf("\n");
             break;
         }
+        status = mx_run_line(line, (size_t)len);
+    }
+    free(line);
+    return status;
+}
 
-        line[strcspn(line, "\n")] = 0;
-
-        if (strlen(line) == 0) {
-            continue;
+static int run_script_file(const char *path) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        fprintf(stderr, "mx: %s: %s\n", path, strerror(errno));
+        return 127;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+        int status = 0;
+        if (st.st_size > 0) {
+            void *data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (data == MAP_FAILED) {
+                fprintf(stderr, "mx: %s: %s\n", path, strerror(errno));
+                close(fd);
+                return 1;
+            }
+            close(fd);
+            madvise(data, (size_t)st.st_size, MADV_SEQUENTIAL);
+            status = run_script((const char *)data, (size_t)st.st_size);
+            munmap(data, (size_t)st.st_size);
+            return status;
         }
+        close(fd);
+        return status;
+    }
+    FILE *fp = fdopen(fd, "r");
+    if (fp == NULL) {
+        fprintf(stderr, "mx: %s: %s\n", path, strerror(errno));
+        close(fd);
+        return 1;
+    }
+    int status = run_stream(fp, 0);
+    fclose(fp);
+    return status;
+}
 
-        int i = 0;
-        token = strtok(line, " ");
-        while (token != NULL && i < MAX_ARGS - 1) {
-            args[i++] = token;
-            token = strtok(NULL, " ");
-        }
-        args[i] = NULL;
-        int num_args = i;
+int main(int argc, char *argv[]){
+    char *prog_name = basename(argv[0]);
+    mx_stats_init();
+    mx_builtin_fn applet = mx_find_builtin(prog_name);
+    if (applet != NULL) return mx_call_builtin(prog_name, applet, argc, argv);
 
-        if (num_args == 0) {
-            continue;
+    if (argc > 1) {
+        if (strcmp(argv[1], "-c") == 0) {
+            if (argc < 3) {
+                fprintf(stderr, "mx: -c: option requires an argument\n");
+                return 2;
+            }
+            return run_script(argv[2], strlen(argv[2]));
         }
-
-        const char *cmd = args[0];
-
-        if (strcmp(cmd, "echo") == 0) {
-            status = mx_echo(num_args, args);
-        } else if (strcmp(cmd, "ls") == 0) {
-            status = mx_ls(num_args, args);
-        } else if (strcmp(cmd, "mkdir") == 0) {
-            status = mx_mkdir(num_args, args);
-        } else if (strcmp(cmd, "rm") == 0) {
-            status = mx_rm(num_args, args);
-        } else if (strcmp(cmd, "rmdir") == 0) {
-            status = mx_rmdir(num_args, args);
-        } else if (strcmp(cmd, "cat") == 0) {
-            status = mx_cat(num_args, args);
-        } else if (strcmp(cmd, "cd") == 0) {
-            status = mx_cd(num_args, args);
-        } else if (strcmp(cmd, "grep") == 0) {
-            status = mgrip_cmd_internal(num_args, args);
-        } else if (strcmp(cmd, "list") == 0) {
-            status = mx_list(num_args, args);
-        } else if (strcmp(cmd, "mxa") == 0) {
-            status = mxa_dispatch_command(num_args, args);
-        } else if (strcmp(cmd, "exit") == 0) {
-            mx_exit(num_args, args);
-        } else {
-            fprintf(stderr, "mx: %s: command not found\n", cmd);
-            status = 127;
+        if (strcmp(argv[1], "--serve") == 0) {
+            if (argc < 3) {
+                fprintf(stderr, "Usage: %s --serve <socket>\n", argv[0]);
+                return 2;
+            }
+            return mx_serve(argv[2]);
+        }
+        if (strcmp(argv[1], "--client") == 0) {
+            if (argc < 4) {
+                fprintf(stderr, "Usage: %s --client <socket> <command> [arguments...]\n", argv[0]);
+                return 2;
+            }
+            int status;
+            if (mx_client_run(argv[2], argc - 3, argv + 3, &status) != 0) {
+                fprintf(stderr, "mx: cannot reach server on %s\n", argv[2]);
+                return 1;
+            }
+            return status;
         }
+        /* "mx -- name" or a name with a slash is always a script, even when it matches a builtin. */
+        if (strcmp(argv[1], "--") == 0) {
+            if (argc < 3) {
+                fprintf(stderr, "Usage: %s -- <script>\n", argv[0]);
+                return 2;
+            }
+            return run_script_file(argv[2]);
+        }
+        applet = strchr(argv[1], '/') == NULL ? mx_find_builtin(argv[1]) : NULL;
+        if (applet != NULL) return mx_call_builtin(argv[1], applet, argc - 1, argv + 1);
+        return run_script_file(argv[1]);
     }
-    
-    return status;
+
+    return run_stream(stdin, isatty(STDIN_FILENO));
 }
@@ -0,0 +1,349 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include "mx_pipeline.h"
+#include "mx_builtins.h"
+#include "mx_exec.h"
+
+#define MX_MAX_STAGES 16
+#define MX_STAGE_ARGS 64
+#define MX_PIPE_SIZE (1 << 20)
+#define MX_LINE_BUFFER 4096
+
+enum mx_token_type {
+    TOKEN_WORD = 0,
+    TOKEN_PIPE,
+    TOKEN_IN,
+    TOKEN_OUT,
+    TOKEN_APPEND
+};
+
+struct mx_stage {
+    char **argv;
+    int argc;
+    int argv_cap;
+    const char *in_file;
+    const char *out_file;
+    int append;
+    char *local_argv[MX_STAGE_ARGS + 1];
+};
+
+static const char *token_text(enum mx_token_type type) {
+    switch (type) {
+        case TOKEN_PIPE: return "|";
+        case TOKEN_IN: return "<";
+        case TOKEN_OUT: return ">";
+        case TOKEN_APPEND: return ">>";
+        default: return "newline";
+    }
+}
+
+static int is_blank(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+static int is_operator(char c) {
+    return c == '|' || c == '<' || c == '>';
+}
+
+static void stage_init(struct mx_stage *stage) {
+    memset(stage, 0, sizeof(*stage));
+    stage->argv = stage->local_argv;
+    stage->argv_cap = MX_STAGE_ARGS;
+}
+
+/* argv starts in the stage itself; a stage with more words moves it to the heap and doubles it. */
+static int stage_push(struct mx_stage *stage, char *word) {
+    if (stage->argc == stage->argv_cap) {
+        int cap = stage->argv_cap * 2;
+        char **grown;
+        if (stage->argv == stage->local_argv) {
+            grown = (char **)malloc(((size_t)cap + 1) * sizeof(char *));
+            if (grown != NULL) memcpy(grown, stage->argv, (size_t)stage->argc * sizeof(char *));
+        } else {
+            grown = (char **)realloc(stage->argv, ((size_t)cap + 1) * sizeof(char *));
+        }
+        if (grown == NULL) {
+            fprintf(stderr, "mx: out of memory\n");
+            return -1;
+        }
+        stage->argv = grown;
+        stage->argv_cap = cap;
+    }
+    stage->argv[stage->argc++] = word;
+    stage->argv[stage->argc] = NULL;
+    return 0;
+}
+
+static void free_stages(struct mx_stage *stages, int count) {
+    for (int i = 0; i < count; ++i) {
+        if (stages[i].argv != stages[i].local_argv) free(stages[i].argv);
+    }
+}
+
+/*
+ * Splits line into NUL-terminated words in buf; operators become their own
+ * tokens. *num_stages counts the stages set up so far, even on error, so
+ * the caller can release them.
+ */
+static int parse_line(const char *line, size_t len, char *buf, struct mx_stage *stages, int *num_stages) {
+    struct mx_stage *stage = &stages[0];
+    stage_init(stage);
+    int count = 1;
+    *num_stages = count;
+    enum mx_token_type pending = TOKEN_WORD;
+    size_t pos = 0;
+
+    while (pos < len) {
+        if (is_blank(line[pos])) {
+            pos++;
+            continue;
+        }
+        if (line[pos] == '#') {
+            break;
+        }
+        if (is_operator(line[pos])) {
+            enum mx_token_type type;
+            if (line[pos] == '|') {
+                type = TOKEN_PIPE;
+            } else if (line[pos] == '<') {
+                type = TOKEN_IN;
+            } else if (pos + 1 < len && line[pos + 1] == '>') {
+                type = TOKEN_APPEND;
+                pos++;
+            } else {
+                type = TOKEN_OUT;
+            }
+            pos++;
+            if (pending != TOKEN_WORD || (type == TOKEN_PIPE && stage->argc == 0)) {
+                fprintf(stderr, "mx: syntax error near unexpected token `%s'\n", token_text(type));
+                return -1;
+            }
+            if (type != TOKEN_PIPE) {
+                pending = type;
+                continue;
+            }
+            if (count == MX_MAX_STAGES) {
+                fprintf(stderr, "mx: too many pipeline stages (max %d)\n", MX_MAX_STAGES);
+                return -1;
+            }
+            stage = &stages[count++];
+            stage_init(stage);
+            *num_stages = count;
+            continue;
+        }
+
+        char *word = buf;
+        while (pos < len && !is_blank(line[pos]) && !is_operator(line[pos])) {
+            *buf++ = line[pos++];
+        }
+        *buf++ = '\0';
+
+        if (pending == TOKEN_IN) {
+            stage->in_file = word;
+        } else if (pending == TOKEN_OUT || pending == TOKEN_APPEND) {
+            stage->out_file = word;
+            stage->append = pending == TOKEN_APPEND;
+        } else {
+            if (stage_push(stage, word) != 0) return -1;
+        }
+        pending = TOKEN_WORD;
+    }
+
+    if (pending != TOKEN_WORD) {
+        fprintf(stderr, "mx: syntax error near unexpected token `newline'\n");
+        return -1;
+    }
+    if (stage->argc == 0 && (count > 1 || stage->in_file || stage->out_file)) {
+        fprintf(stderr, "mx: syntax error: missing command\n");
+        return -1;
+    }
+    if (stage->argc == 0) *num_stages = 0;
+    return 0;
+}
+
+static int open_redirect(const struct mx_stage *stage, int *in_fd, int *out_fd) {
+    if (stage->in_file) {
+        int fd = open(stage->in_file, O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            fprintf(stderr, "mx: %s: %s\n", stage->in_file, strerror(errno));
+            return -1;
+        }
+        if (*in_fd >= 0) close(*in_fd);
+        *in_fd = fd;
+    }
+    if (stage->out_file) {
+        int flags = O_WRONLY | O_CREAT | O_CLOEXEC | (stage->append ? O_APPEND : O_TRUNC);
+        int fd = open(stage->out_file, flags, 0666);
+        if (fd < 0) {
+            fprintf(stderr, "mx: %s: %s\n", stage->out_file, strerror(errno));
+            return -1;
+        }
+        if (*out_fd >= 0) close(*out_fd);
+        *out_fd = fd;
+    }
+    return 0;
+}
+
+/* Stages of a real pipeline run concurrently, so each builtin stage gets its own process. */
+static pid_t start_builtin(mx_builtin_fn fn, struct mx_stage *stage, int in_fd, int out_fd, int unused_fd) {
+    pid_t pid = fork();
+    if (pid != 0) return pid;
+
+    if (unused_fd >= 0) close(unused_fd);
+    if (in_fd >= 0) {
+        dup2(in_fd, STDIN_FILENO);
+        close(in_fd);
+    }
+    if (out_fd >= 0) {
+        dup2(out_fd, STDOUT_FILENO);
+        close(out_fd);
+    }
+    int status = mx_call_builtin(stage->argv[0], fn, stage->argc, stage->argv);
+    fflush(stdout);
+    _exit(status);
+}
+
+/* Points target at fd for the duration of a builtin; returns the saved descriptor, or -1 if target was closed. */
+static int swap_fd(int fd, int target) {
+    int saved = fcntl(target, F_DUPFD_CLOEXEC, 10);
+    dup2(fd, target);
+    close(fd);
+    return saved;
+}
+
+static void restore_fd(int saved, int target) {
+    if (saved >= 0) {
+        dup2(saved, target);
+        close(saved);
+    } else {
+        close(target);
+    }
+}
+
+/*
+ * A lone builtin runs in the shell process even when redirected, so cd,
+ * exit and hash keep their effect; only descriptors 0 and 1 are swapped
+ * around the call. Builtins read input with read() on fd 0, so the stdin
+ * FILE buffer (which may hold the rest of a script) is left untouched.
+ */
+static int run_builtin_redirected(mx_builtin_fn fn, struct mx_stage *stage) {
+    int in_fd = -1;
+    int out_fd = -1;
+    if (open_redirect(stage, &in_fd, &out_fd) != 0) {
+        if (in_fd >= 0) close(in_fd);
+        if (out_fd >= 0) close(out_fd);
+        return 1;
+    }
+    fflush(stdout);
+    int saved_in = -1;
+    int saved_out = -1;
+    if (in_fd >= 0) saved_in = swap_fd(in_fd, STDIN_FILENO);
+    if (out_fd >= 0) saved_out = swap_fd(out_fd, STDOUT_FILENO);
+    int status = mx_call_builtin(stage->argv[0], fn, stage->argc, stage->argv);
+    fflush(stdout);
+    if (out_fd >= 0) restore_fd(saved_out, STDOUT_FILENO);
+    if (in_fd >= 0) restore_fd(saved_in, STDIN_FILENO);
+    return status;
+}
+
+static int run_pipeline(struct mx_stage *stages, int num_stages) {
+    if (num_stages == 1) {
+        if (!stages[0].in_file && !stages[0].out_file) {
+            return mx_run_argv(stages[0].argc, stages[0].argv);
+        }
+        mx_builtin_fn fn = mx_find_builtin(stages[0].argv[0]);
+        if (fn != NULL) return run_builtin_redirected(fn, &stages[0]);
+    }
+
+    pid_t pids[MX_MAX_STAGES];
+    int stage_status[MX_MAX_STAGES];
+    int prev_read = -1;
+    fflush(stdout);
+
+    for (int i = 0; i < num_stages; ++i) {
+        int in_fd = prev_read;
+        int out_fd = -1;
+        int next_read = -1;
+        prev_read = -1;
+        pids[i] = -1;
+        stage_status[i] = 0;
+
+        if (i < num_stages - 1) {
+            int pipe_fds[2];
+            if (pipe2(pipe_fds, O_CLOEXEC) != 0) {
+                perror("mx: pipe");
+                if (in_fd >= 0) close(in_fd);
+                stage_status[i] = 1;
+                for (int j = i + 1; j < num_stages; ++j) {
+                    pids[j] = -1;
+                    stage_status[j] = 1;
+                }
+                break;
+            }
+            fcntl(pipe_fds[1], F_SETPIPE_SZ, MX_PIPE_SIZE);
+            next_read = pipe_fds[0];
+            out_fd = pipe_fds[1];
+        }
+
+        if (open_redirect(&stages[i], &in_fd, &out_fd) != 0) {
+            stage_status[i] = 1;
+        } else {
+            mx_builtin_fn fn = mx_find_builtin(stages[i].argv[0]);
+            if (fn != NULL) {
+                pids[i] = start_builtin(fn, &stages[i], in_fd, out_fd, next_read);
+                if (pids[i] < 0) {
+                    perror("mx: fork");
+                    stage_status[i] = 1;
+                }
+            } else {
+                stage_status[i] = mx_spawn_command(stages[i].argv, in_fd, out_fd, &pids[i]);
+                if (stage_status[i] != 0) pids[i] = -1;
+            }
+        }
+        if (in_fd >= 0) close(in_fd);
+        if (out_fd >= 0) close(out_fd);
+        prev_read = next_read;
+    }
+    if (prev_read >= 0) close(prev_read);
+
+    for (int i = 0; i < num_stages; ++i) {
+        if (pids[i] > 0) {
+            stage_status[i] = mx_wait_command(pids[i]);
+        }
+    }
+    return stage_status[num_stages - 1];
+}
+
+/*
+ * Words and stages live on the stack, so a script line costs no heap
+ * allocation; only a line longer than MX_LINE_BUFFER, or a stage with more
+ * than MX_STAGE_ARGS words, spills to the heap.
+ */
+int mx_run_line(const char *line, size_t len) {
+    char local[MX_LINE_BUFFER];
+    char *buf = local;
+    struct mx_stage stages[MX_MAX_STAGES];
+    if (len >= sizeof(local)) {
+        buf = (char *)malloc(len + 1);
+        if (buf == NULL) {
+            fprintf(stderr, "mx: out of memory\n");
+            return 1;
+        }
+    }
+    int num_stages = 0;
+    int status = 0;
+    if (parse_line(line, len, buf, stages, &num_stages) != 0) {
+        status = 2;
+    } else if (num_stages > 0) {
+        status = run_pipeline(stages, num_stages);
+    }
+    free_stages(stages, num_stages);
+    if (buf != local) free(buf);
+    return status;
+}
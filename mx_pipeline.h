@@ -0,0 +1,8 @@
+#ifndef MX_PIPELINE_H
+#define MX_PIPELINE_H
+
+#include <stddef.h>
+
+int mx_run_line(const char *line, size_t len);
+
+#endif
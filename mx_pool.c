@@ -0,0 +1,137 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "mx_pool.h"
+
+struct mx_task {
+    mx_task_fn fn;
+    void *arg;
+    struct mx_task *next;
+};
+
+struct mx_pool {
+    pthread_mutex_t lock;
+    pthread_cond_t work_cond;
+    pthread_cond_t idle_cond;
+    struct mx_task *head;
+    struct mx_task *tail;
+    size_t queued;
+    size_t active;
+    int stopping;
+    int nthreads;
+    pthread_t *threads;
+};
+
+static void *mx_pool_worker(void *arg) {
+    mx_pool *pool = (mx_pool *)arg;
+    pthread_mutex_lock(&pool->lock);
+    while (1) {
+        while (pool->head == NULL && !pool->stopping) {
+            pthread_cond_wait(&pool->work_cond, &pool->lock);
+        }
+        if (pool->head == NULL && pool->stopping) {
+            break;
+        }
+        struct mx_task *task = pool->head;
+        pool->head = task->next;
+        if (pool->head == NULL) pool->tail = NULL;
+        pool->queued--;
+        pool->active++;
+        pthread_mutex_unlock(&pool->lock);
+
+        task->fn(task->arg);
+        free(task);
+
+        pthread_mutex_lock(&pool->lock);
+        pool->active--;
+        if (pool->head == NULL && pool->active == 0) {
+            pthread_cond_broadcast(&pool->idle_cond);
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+mx_pool *mx_pool_create(int nthreads) {
+    if (nthreads <= 0) {
+        long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+        nthreads = ncpu > 0 ? (int)ncpu : 1;
+    }
+    mx_pool *pool = (mx_pool *)calloc(1, sizeof(*pool));
+    if (pool == NULL) return NULL;
+    pool->threads = (pthread_t *)calloc((size_t)nthreads, sizeof(pthread_t));
+    if (pool->threads == NULL) {
+        free(pool);
+        return NULL;
+    }
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work_cond, NULL);
+    pthread_cond_init(&pool->idle_cond, NULL);
+    for (int i = 0; i < nthreads; ++i) {
+        if (pthread_create(&pool->threads[i], NULL, mx_pool_worker, pool) != 0) {
+            break;
+        }
+        pool->nthreads++;
+    }
+    if (pool->nthreads == 0) {
+        mx_pool_destroy(pool);
+        return NULL;
+    }
+    return pool;
+}
+
+int mx_pool_submit(mx_pool *pool, mx_task_fn fn, void *arg) {
+    struct mx_task *task = (struct mx_task *)malloc(sizeof(*task));
+    if (task == NULL) return -1;
+    task->fn = fn;
+    task->arg = arg;
+    task->next = NULL;
+    pthread_mutex_lock(&pool->lock);
+    if (pool->tail) {
+        pool->tail->next = task;
+    } else {
+        pool->head = task;
+    }
+    pool->tail = task;
+    pool->queued++;
+    pthread_cond_signal(&pool->work_cond);
+    pthread_mutex_unlock(&pool->lock);
+    return 0;
+}
+
+size_t mx_pool_backlog(mx_pool *pool) {
+    pthread_mutex_lock(&pool->lock);
+    size_t queued = pool->queued;
+    pthread_mutex_unlock(&pool->lock);
+    return queued;
+}
+
+int mx_pool_threads(mx_pool *pool) {
+    return pool->nthreads;
+}
+
+void mx_pool_wait(mx_pool *pool) {
+    pthread_mutex_lock(&pool->lock);
+    while (pool->head != NULL || pool->active != 0) {
+        pthread_cond_wait(&pool->idle_cond, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void mx_pool_destroy(mx_pool *pool) {
+    if (pool == NULL) return;
+    pthread_mutex_lock(&pool->lock);
+    pool->stopping = 1;
+    pthread_cond_broadcast(&pool->work_cond);
+    pthread_mutex_unlock(&pool->lock);
+    for (int i = 0; i < pool->nthreads; ++i) {
+        pthread_join(pool->threads[i], NULL);
+    }
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->work_cond);
+    pthread_cond_destroy(&pool->idle_cond);
+    free(pool->threads);
+    free(pool);
+}
@@ -0,0 +1,18 @@
+#ifndef MX_POOL_H
+#define MX_POOL_H
+
+#include <stddef.h>
+
+typedef void (*mx_task_fn)(void *arg);
+
+typedef struct mx_pool mx_pool;
+
+/* nthreads <= 0 means one worker per online CPU. */
+mx_pool *mx_pool_create(int nthreads);
+int mx_pool_submit(mx_pool *pool, mx_task_fn fn, void *arg);
+size_t mx_pool_backlog(mx_pool *pool);
+int mx_pool_threads(mx_pool *pool);
+void mx_pool_wait(mx_pool *pool);
+void mx_pool_destroy(mx_pool *pool);
+
+#endif
@@ -0,0 +1,338 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include "mx_server.h"
+#include "mx_builtins.h"
+#include "mx_stats.h"
+
+extern char **environ;
+
+static int fill_address(struct sockaddr_un *addr, const char *socket_path) {
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(addr->sun_path)) {
+        fprintf(stderr, "mx: socket path too long: %s\n", socket_path);
+        return -1;
+    }
+    strcpy(addr->sun_path, socket_path);
+    return 0;
+}
+
+static int read_full(int fd, void *buf, size_t len) {
+    size_t done = 0;
+    while (done < len) {
+        ssize_t n = read(fd, (char *)buf + done, len - done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        done += (size_t)n;
+    }
+    return 0;
+}
+
+static int write_full(int fd, const void *buf, size_t len) {
+    size_t done = 0;
+    while (done < len) {
+        ssize_t n = send(fd, (const char *)buf + done, len - done, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        done += (size_t)n;
+    }
+    return 0;
+}
+
+static int recv_header(int conn, struct mx_request_header *header, int fds[MX_SERVER_FDS]) {
+    union {
+        char buf[CMSG_SPACE(MX_SERVER_FDS * sizeof(int))];
+        struct cmsghdr align;
+    } control;
+    struct iovec iov = { header, sizeof(*header) };
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+
+    ssize_t n;
+    do {
+        n = recvmsg(conn, &msg, MSG_CMSG_CLOEXEC);
+    } while (n < 0 && errno == EINTR);
+    if (n <= 0) return -1;
+
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    if (cmsg == NULL || cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS ||
+        cmsg->cmsg_len != CMSG_LEN(MX_SERVER_FDS * sizeof(int))) {
+        return -1;
+    }
+    memcpy(fds, CMSG_DATA(cmsg), MX_SERVER_FDS * sizeof(int));
+    if ((size_t)n < sizeof(*header) &&
+        read_full(conn, (char *)header + n, sizeof(*header) - (size_t)n) != 0) {
+        return -1;
+    }
+    return 0;
+}
+
+static int reply_fd = -1;
+
+/* Registered with on_exit, so a builtin that calls exit() (exit itself, for one) still answers the client. */
+static void send_status(int status, void *arg) {
+    (void)arg;
+    fflush(stdout);
+    fflush(stderr);
+    int32_t reply = status;
+    if (reply_fd >= 0) write_full(reply_fd, &reply, sizeof(reply));
+}
+
+/* Takes on the client's stdio, working directory, umask and environment, runs the command, and exits. */
+static void handle_request(int conn) {
+    struct mx_request_header header;
+    int fds[MX_SERVER_FDS] = { -1, -1, -1, -1 };
+
+    if (recv_header(conn, &header, fds) != 0 || header.magic != MX_SERVER_MAGIC ||
+        header.argc == 0 || header.payload_len == 0 || header.payload_len > MX_SERVER_MAX_PAYLOAD) {
+        _exit(1);
+    }
+    char *payload = (char *)malloc(header.payload_len);
+    char **argv = (char **)calloc(header.argc + 1, sizeof(char *));
+    if (payload == NULL || argv == NULL || read_full(conn, payload, header.payload_len) != 0 ||
+        payload[header.payload_len - 1] != '\0') {
+        _exit(1);
+    }
+
+    char *pos = payload;
+    char *end = payload + header.payload_len;
+    for (uint32_t i = 0; i < header.argc; ++i) {
+        if (pos >= end) _exit(1);
+        argv[i] = pos;
+        pos += strlen(pos) + 1;
+    }
+    clearenv();
+    for (uint32_t i = 0; i < header.envc; ++i) {
+        if (pos >= end) _exit(1);
+        putenv(pos);
+        pos += strlen(pos) + 1;
+    }
+    umask((mode_t)header.umask);
+    for (int i = 0; i < 3; ++i) {
+        dup2(fds[i], i);
+        close(fds[i]);
+    }
+    int cwd_ok = fchdir(fds[3]) == 0;
+    int cwd_err = errno;
+    close(fds[3]);
+
+    reply_fd = conn;
+    on_exit(send_status, NULL);
+    if (!cwd_ok) {
+        fprintf(stderr, "mx: cannot enter the client's directory: %s\n", strerror(cwd_err));
+        exit(1);
+    }
+    mx_stats_init();
+    exit(mx_run_argv((int)header.argc, argv));
+}
+
+static int peer_allowed(int conn) {
+    struct ucred cred;
+    socklen_t cred_len = sizeof(cred);
+    return getsockopt(conn, SOL_SOCKET, SO_PEERCRED, &cred, &cred_len) == 0 &&
+           (cred.uid == getuid() || cred.uid == 0);
+}
+
+/* A worker serves exactly one request, so every command starts from the server's clean state. */
+static void worker_main(int listen_fd, pid_t server) {
+    /* Idle workers must not outlive the server and keep the socket open. */
+    prctl(PR_SET_PDEATHSIG, SIGTERM);
+    if (getppid() != server) _exit(0);
+    signal(SIGPIPE, SIG_DFL);
+    while (1) {
+        int conn = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC);
+        if (conn < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            perror("mx --serve: accept");
+            _exit(1);
+        }
+        if (!peer_allowed(conn)) {
+            close(conn);
+            continue;
+        }
+        close(listen_fd);
+        handle_request(conn);
+    }
+}
+
+static pid_t start_worker(int listen_fd) {
+    fflush(stdout);
+    fflush(stderr);
+    pid_t server = getpid();
+    pid_t pid = fork();
+    if (pid == 0) worker_main(listen_fd, server);
+    if (pid < 0) perror("mx --serve: fork");
+    return pid;
+}
+
+/*
+ * Pre-forked workers wait in accept() on the shared socket; the server
+ * only replaces each one after it has served its request, so fork() is
+ * off the latency path as long as requests do not outrun the pool.
+ */
+int mx_serve(const char *socket_path) {
+    struct sockaddr_un addr;
+    if (fill_address(&addr, socket_path) != 0) return 1;
+
+    int listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listen_fd < 0) {
+        perror("mx --serve: socket");
+        return 1;
+    }
+    if (connect(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) == 0) {
+        fprintf(stderr, "mx --serve: a server is already listening on %s\n", socket_path);
+        close(listen_fd);
+        return 1;
+    }
+    struct stat st;
+    if (lstat(socket_path, &st) == 0 && S_ISSOCK(st.st_mode)) {
+        unlink(socket_path);
+    }
+
+    /*
+     * Bind under a temporary name and rename into place once listening,
+     * so a client that finds the socket path is never refused.
+     */
+    struct sockaddr_un bind_addr = addr;
+    int len = snprintf(bind_addr.sun_path, sizeof(bind_addr.sun_path), "%s.%ld",
+                       socket_path, (long)getpid());
+    int renaming = len > 0 && (size_t)len < sizeof(bind_addr.sun_path);
+    if (!renaming) bind_addr = addr;
+
+    mode_t old_umask = umask(0077);
+    int bound = bind(listen_fd, (struct sockaddr *)&bind_addr, sizeof(bind_addr)) == 0;
+    umask(old_umask);
+    int ret = bound ? listen(listen_fd, SOMAXCONN) : -1;
+    if (ret == 0 && renaming) ret = rename(bind_addr.sun_path, socket_path);
+    if (ret != 0) {
+        perror("mx --serve");
+        if (bound && renaming) unlink(bind_addr.sun_path);
+        close(listen_fd);
+        return 1;
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int workers = cpus > MX_SERVER_MIN_WORKERS ? (int)cpus : MX_SERVER_MIN_WORKERS;
+    fprintf(stderr, "mx: serving on %s with %d workers\n", socket_path, workers);
+
+    int running = 0;
+    while (1) {
+        while (running < workers && start_worker(listen_fd) > 0) running++;
+        if (running == 0) {
+            sleep(1);
+            continue;
+        }
+        if (wait(NULL) > 0) {
+            running--;
+        } else if (errno != EINTR) {
+            perror("mx --serve: wait");
+            break;
+        }
+    }
+    close(listen_fd);
+    unlink(socket_path);
+    return 1;
+}
+
+int mx_client_run(const char *socket_path, int argc, char *argv[], int *status) {
+    struct sockaddr_un addr;
+    if (fill_address(&addr, socket_path) != 0) return -1;
+    int conn = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (conn < 0) return -1;
+    if (connect(conn, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        close(conn);
+        return -1;
+    }
+
+    int cwd_fd = open(".", O_PATH | O_DIRECTORY | O_CLOEXEC);
+    if (cwd_fd < 0) {
+        close(conn);
+        return -1;
+    }
+    size_t payload_len = 0;
+    int envc = 0;
+    for (int i = 0; i < argc; ++i) {
+        payload_len += strlen(argv[i]) + 1;
+    }
+    for (; environ[envc] != NULL; ++envc) {
+        payload_len += strlen(environ[envc]) + 1;
+    }
+    char *payload = payload_len <= MX_SERVER_MAX_PAYLOAD ? (char *)malloc(payload_len) : NULL;
+    if (payload == NULL) {
+        close(cwd_fd);
+        close(conn);
+        return -1;
+    }
+    size_t pos = 0;
+    for (int i = 0; i < argc; ++i) {
+        size_t len = strlen(argv[i]) + 1;
+        memcpy(payload + pos, argv[i], len);
+        pos += len;
+    }
+    for (int i = 0; i < envc; ++i) {
+        size_t len = strlen(environ[i]) + 1;
+        memcpy(payload + pos, environ[i], len);
+        pos += len;
+    }
+    mode_t mask = umask(0);
+    umask(mask);
+
+    struct mx_request_header header = { MX_SERVER_MAGIC, (uint32_t)argc, (uint32_t)envc, (uint32_t)mask,
+                                        (uint32_t)payload_len };
+    int fds[MX_SERVER_FDS] = { STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO, cwd_fd };
+    union {
+        char buf[CMSG_SPACE(MX_SERVER_FDS * sizeof(int))];
+        struct cmsghdr align;
+    } control;
+    memset(&control, 0, sizeof(control));
+    struct iovec iov = { &header, sizeof(header) };
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+    ssize_t sent;
+    do {
+        sent = sendmsg(conn, &msg, MSG_NOSIGNAL);
+    } while (sent < 0 && errno == EINTR);
+    close(cwd_fd);
+    if (sent != (ssize_t)sizeof(header) || write_full(conn, payload, payload_len) != 0) {
+        free(payload);
+        close(conn);
+        return -1;
+    }
+    free(payload);
+
+    /* From here on the command has been handed over; don't fall back to running it locally. */
+    int32_t remote_status;
+    if (read_full(conn, &remote_status, sizeof(remote_status)) != 0) {
+        fprintf(stderr, "mx: lost connection to server on %s\n", socket_path);
+        remote_status = 1;
+    }
+    close(conn);
+    *status = remote_status;
+    return 0;
+}
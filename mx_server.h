@@ -0,0 +1,29 @@
+#ifndef MX_SERVER_H
+#define MX_SERVER_H
+
+/*
+ * Request on the stream socket: a struct mx_request_header carrying the
+ * client's stdin, stdout, stderr and an O_PATH descriptor of its working
+ * directory as SCM_RIGHTS, followed by payload_len bytes holding argc
+ * arguments and then envc environment entries, each NUL-terminated. The
+ * server answers with the command's exit status as an int32_t.
+ */
+#define MX_SERVER_MAGIC 0x4d58534cu
+#define MX_SERVER_MAX_PAYLOAD (1 << 20)
+#define MX_SERVER_FDS 4
+#define MX_SERVER_MIN_WORKERS 2
+
+#include <stdint.h>
+
+struct mx_request_header {
+    uint32_t magic;
+    uint32_t argc;
+    uint32_t envc;
+    uint32_t umask;
+    uint32_t payload_len;
+};
+
+int mx_serve(const char *socket_path);
+int mx_client_run(const char *socket_path, int argc, char *argv[], int *status);
+
+#endif
@@ -0,0 +1,156 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdatomic.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include "mx_stats.h"
+#include "mx_builtins.h"
+
+int mx_stats_mode = MX_STATS_OFF;
+
+static _Atomic uint64_t counters[MX_STAT_COUNT];
+/* syscr + syscw at mx_stats_begin; -1 when /proc/self/io cannot be read. */
+static int64_t io_syscalls_start = -1;
+
+static const char *counter_names[MX_STAT_COUNT] = {
+    "bytes_read",
+    "bytes_written",
+    "rw_syscalls",
+    "matches",
+    "blocks_compressed",
+    "rle_ns",
+    "lz_lite_ns",
+    "lz_dict_ns",
+};
+
+void mx_stats_init(void) {
+    const char *env = getenv("MX_STATS");
+    if (env == NULL || env[0] == '\0' || strcmp(env, "0") == 0) {
+        mx_stats_mode = MX_STATS_OFF;
+    } else if (strcmp(env, "json") == 0) {
+        mx_stats_mode = MX_STATS_JSON;
+    } else {
+        mx_stats_mode = MX_STATS_TEXT;
+    }
+}
+
+void mx_stats_add(enum mx_stat_counter counter, uint64_t n) {
+    atomic_fetch_add_explicit(&counters[counter], n, memory_order_relaxed);
+}
+
+uint64_t mx_stats_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+/* Returns syscr + syscw of this process, or -1 without /proc. */
+static int64_t read_io_syscalls(void) {
+    char buffer[512];
+    int fd = open("/proc/self/io", O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+    ssize_t n = read(fd, buffer, sizeof(buffer) - 1);
+    close(fd);
+    if (n <= 0) return -1;
+    buffer[n] = '\0';
+    const char *syscr = strstr(buffer, "syscr: ");
+    const char *syscw = strstr(buffer, "syscw: ");
+    if (syscr == NULL || syscw == NULL) return -1;
+    return strtoll(syscr + 7, NULL, 10) + strtoll(syscw + 7, NULL, 10);
+}
+
+void mx_stats_begin(void) {
+    for (int i = 0; i < MX_STAT_COUNT; ++i) {
+        atomic_store_explicit(&counters[i], 0, memory_order_relaxed);
+    }
+    io_syscalls_start = read_io_syscalls();
+}
+
+/* The read() of /proc/self/io in mx_stats_begin lands in the second sample and is taken off. */
+static int64_t rw_syscalls_since_begin(void) {
+    int64_t now = io_syscalls_start >= 0 ? read_io_syscalls() : -1;
+    if (now < 0) return -1;
+    return now - io_syscalls_start - 1;
+}
+
+/* Without /proc there is no rw_syscalls count, so it is left out of the report. */
+void mx_stats_report(const char *cmd, int status) {
+    if (mx_stats_mode == MX_STATS_OFF) return;
+    uint64_t values[MX_STAT_COUNT];
+    for (int i = 0; i < MX_STAT_COUNT; ++i) {
+        values[i] = atomic_load_explicit(&counters[i], memory_order_relaxed);
+    }
+    int64_t rw_syscalls = rw_syscalls_since_begin();
+    values[MX_STAT_RW_SYSCALLS] = rw_syscalls >= 0 ? (uint64_t)rw_syscalls : 0;
+
+    if (mx_stats_mode == MX_STATS_JSON) {
+        fprintf(stderr, "{\"cmd\":\"%s\",\"status\":%d", cmd, status);
+    } else {
+        fprintf(stderr, "mx stats: %s: status=%d", cmd, status);
+    }
+    for (int i = 0; i < MX_STAT_COUNT; ++i) {
+        if (i == MX_STAT_RW_SYSCALLS && rw_syscalls < 0) continue;
+        if (mx_stats_mode == MX_STATS_JSON) {
+            fprintf(stderr, ",\"%s\":%llu", counter_names[i], (unsigned long long)values[i]);
+        } else {
+            fprintf(stderr, " %s=%llu", counter_names[i], (unsigned long long)values[i]);
+        }
+    }
+    fprintf(stderr, mx_stats_mode == MX_STATS_JSON ? "}\n" : "\n");
+}
+
+static double timeval_seconds(struct timeval tv) {
+    return (double)tv.tv_sec + (double)tv.tv_usec / 1e6;
+}
+
+/*
+ * The command runs in a child so that wait4 reports its time apart from the
+ * shell's. The child starts with the shell's resident pages, so maxrss is
+ * the command's peak plus what the shell had resident at fork: an upper
+ * bound, close to the command's own peak only when the shell is small. cd
+ * and exit would only change the child, so they are refused.
+ */
+int mx_time(int argc, char *argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: time <command> [arguments...]\n");
+        return 1;
+    }
+    if (strcmp(argv[1], "cd") == 0 || strcmp(argv[1], "exit") == 0) {
+        fprintf(stderr, "mx time: %s cannot be timed: it would not affect the shell\n", argv[1]);
+        return 1;
+    }
+    fflush(stdout);
+    uint64_t start = mx_stats_now_ns();
+    pid_t pid = fork();
+    if (pid == 0) {
+        int child_status = mx_run_argv(argc - 1, argv + 1);
+        fflush(stdout);
+        _exit(child_status);
+    }
+    if (pid < 0) {
+        perror("mx time: fork");
+        return 1;
+    }
+    int wstatus;
+    struct rusage usage;
+    while (wait4(pid, &wstatus, 0, &usage) < 0) {
+        if (errno != EINTR) {
+            perror("mx time: wait4");
+            return 1;
+        }
+    }
+    uint64_t end = mx_stats_now_ns();
+    int status = WIFEXITED(wstatus) ? WEXITSTATUS(wstatus) : 128 + WTERMSIG(wstatus);
+
+    fprintf(stderr, "\nreal\t%.3fs\nuser\t%.3fs\nsys\t%.3fs\nmaxrss\t%ld KiB\n",
+            (double)(end - start) / 1e9, timeval_seconds(usage.ru_utime), timeval_seconds(usage.ru_stime),
+            usage.ru_maxrss);
+    return status;
+}
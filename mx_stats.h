@@ -0,0 +1,40 @@
+#ifndef MX_STATS_H
+#define MX_STATS_H
+
+#include <stdint.h>
+
+enum mx_stat_counter {
+    MX_STAT_BYTES_READ = 0,
+    MX_STAT_BYTES_WRITTEN,
+    MX_STAT_RW_SYSCALLS,
+    MX_STAT_MATCHES,
+    MX_STAT_BLOCKS_COMPRESSED,
+    MX_STAT_RLE_NS,
+    MX_STAT_LZ_LITE_NS,
+    MX_STAT_LZ_DICT_NS,
+    MX_STAT_COUNT
+};
+
+extern int mx_stats_mode;
+
+#define MX_STATS_OFF 0
+#define MX_STATS_TEXT 1
+#define MX_STATS_JSON 2
+
+#define MX_STAT_ADD(counter, n) \
+    do { if (mx_stats_mode) mx_stats_add((counter), (uint64_t)(n)); } while (0)
+
+/*
+ * rw_syscalls is not counted by mx: it is the kernel's syscr + syscw from
+ * /proc/self/io over the command, so it covers every read- and write-family
+ * call of the process, stdio and threads included, and nothing else.
+ */
+
+void mx_stats_init(void);
+void mx_stats_add(enum mx_stat_counter counter, uint64_t n);
+uint64_t mx_stats_now_ns(void);
+void mx_stats_begin(void);
+void mx_stats_report(const char *cmd, int status);
+int mx_time(int argc, char *argv[]);
+
+#endif
@@ -0,0 +1,295 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "mxa_dict.h"
+#include "mxa_functions.h"
+#include "mx_stats.h"
+
+uint32_t mxa_dict_id(const unsigned char *data, size_t size) {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < size; ++i) {
+        h ^= data[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+struct mxa_dict *mxa_dict_create(const unsigned char *data, size_t size) {
+    struct mxa_dict *dict = (struct mxa_dict *)calloc(1, sizeof(*dict));
+    if (dict == NULL) return NULL;
+    dict->data = (unsigned char *)malloc(size ? size : 1);
+    if (dict->data == NULL) {
+        free(dict);
+        return NULL;
+    }
+    memcpy(dict->data, data, size);
+    dict->size = size;
+    dict->id = mxa_dict_id(data, size);
+    return dict;
+}
+
+void mxa_dict_free(struct mxa_dict *dict) {
+    if (dict == NULL) return;
+    free(dict->data);
+    free(dict->head);
+    free(dict->prev);
+    free(dict);
+}
+
+int mxa_dict_index(struct mxa_dict *dict) {
+    if (dict->head != NULL) return 0;
+    dict->head = (uint32_t *)calloc(LZ_DICT_HASH_SIZE, sizeof(uint32_t));
+    dict->prev = (uint32_t *)calloc(dict->size ? dict->size : 1, sizeof(uint32_t));
+    if (dict->head == NULL || dict->prev == NULL) {
+        free(dict->head);
+        free(dict->prev);
+        dict->head = NULL;
+        dict->prev = NULL;
+        return -1;
+    }
+    for (size_t pos = 0; pos + 4 <= dict->size; ++pos) {
+        uint32_t h = lz_dict_hash(dict->data + pos);
+        dict->prev[pos] = dict->head[h];
+        dict->head[h] = (uint32_t)pos + 1;
+    }
+    return 0;
+}
+
+/* Appends a whole regular file to *buffer, growing it as needed. */
+static int read_file_into(const char *path, unsigned char **buffer, size_t *len, size_t *cap) {
+    /* Non-blocking so a FIFO is turned away by the type check rather than waiting for a writer. */
+    int fd = open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0) {
+        perror(path);
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        fprintf(stderr, "%s: not a regular file, skipping.\n", path);
+        close(fd);
+        return 1;
+    }
+    size_t size = (size_t)st.st_size;
+    if (*len + size > *cap) {
+        size_t new_cap = *cap ? *cap : 64 * 1024;
+        while (new_cap < *len + size) new_cap *= 2;
+        unsigned char *grown = (unsigned char *)realloc(*buffer, new_cap);
+        if (grown == NULL) {
+            fprintf(stderr, "%s: out of memory\n", path);
+            close(fd);
+            return -1;
+        }
+        *buffer = grown;
+        *cap = new_cap;
+    }
+    size_t done = 0;
+    while (done < size) {
+        ssize_t n = read(fd, *buffer + *len + done, size - done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        done += (size_t)n;
+    }
+    close(fd);
+    MX_STAT_ADD(MX_STAT_BYTES_READ, done);
+    *len += done;
+    return 0;
+}
+
+struct mxa_dict *mxa_dict_load(const char *path) {
+    unsigned char *buffer = NULL;
+    size_t len = 0;
+    size_t cap = 0;
+    if (read_file_into(path, &buffer, &len, &cap) != 0) {
+        free(buffer);
+        return NULL;
+    }
+    if (len < MXD_MAGIC_LEN + MXD_ID_LEN || memcmp(buffer, MXD_MAGIC, MXD_MAGIC_LEN) != 0) {
+        fprintf(stderr, "%s: not a valid .mxd dictionary\n", path);
+        free(buffer);
+        return NULL;
+    }
+    const unsigned char *content = buffer + MXD_MAGIC_LEN + MXD_ID_LEN;
+    size_t content_size = len - MXD_MAGIC_LEN - MXD_ID_LEN;
+    uint32_t id = 0;
+    memcpy(&id, buffer + MXD_MAGIC_LEN, MXD_ID_LEN);
+    if (content_size > LZ_DICT_WINDOW_SIZE || id != mxa_dict_id(content, content_size)) {
+        fprintf(stderr, "%s: corrupt dictionary\n", path);
+        free(buffer);
+        return NULL;
+    }
+    struct mxa_dict *dict = mxa_dict_create(content, content_size);
+    free(buffer);
+    return dict;
+}
+
+static uint32_t kmer_hash(const unsigned char *p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return (uint32_t)((v * 0x9E3779B97F4A7C15ull) >> (64 - MXA_TRAIN_HASH_BITS));
+}
+
+/*
+ * Cover-style selection: count in how many samples each 8-byte k-mer
+ * appears (or how often, given a single sample), split the corpus into one
+ * epoch per output segment, and take the segment whose k-mers score
+ * highest in each epoch. Counts of chosen k-mers are zeroed so later
+ * epochs prefer content not yet covered.
+ */
+static long select_segments(const unsigned char *corpus, size_t corpus_len, const size_t *sample_ends,
+                            int samples, unsigned char *dict, size_t dict_cap) {
+    size_t table_size = (size_t)1 << MXA_TRAIN_HASH_BITS;
+    uint32_t *counts = (uint32_t *)calloc(table_size, sizeof(uint32_t));
+    uint32_t *seen = (uint32_t *)calloc(table_size, sizeof(uint32_t));
+    if (counts == NULL || seen == NULL) {
+        free(counts);
+        free(seen);
+        return -1;
+    }
+    size_t start = 0;
+    for (int s = 0; s < samples; ++s) {
+        for (size_t p = start; p + MXA_TRAIN_KMER <= sample_ends[s]; ++p) {
+            uint32_t h = kmer_hash(corpus + p);
+            if (samples == 1 || seen[h] != (uint32_t)s + 1) {
+                seen[h] = (uint32_t)s + 1;
+                counts[h]++;
+            }
+        }
+        start = sample_ends[s];
+    }
+    free(seen);
+
+    size_t segments = dict_cap / MXA_TRAIN_SEGMENT;
+    size_t epoch_len = corpus_len / segments;
+    size_t window_kmers = MXA_TRAIN_SEGMENT - MXA_TRAIN_KMER + 1;
+    size_t dict_len = 0;
+    for (size_t e = 0; e < segments && dict_len + MXA_TRAIN_SEGMENT <= dict_cap; ++e) {
+        size_t epoch_start = e * epoch_len;
+        size_t epoch_end = e + 1 == segments ? corpus_len : epoch_start + epoch_len;
+        if (epoch_end - epoch_start < MXA_TRAIN_SEGMENT) continue;
+
+        uint64_t score = 0;
+        for (size_t k = 0; k < window_kmers; ++k) {
+            score += counts[kmer_hash(corpus + epoch_start + k)];
+        }
+        uint64_t best_score = score;
+        size_t best = epoch_start;
+        for (size_t s = epoch_start + 1; s + MXA_TRAIN_SEGMENT <= epoch_end; ++s) {
+            score -= counts[kmer_hash(corpus + s - 1)];
+            score += counts[kmer_hash(corpus + s + window_kmers - 1)];
+            if (score > best_score) {
+                best_score = score;
+                best = s;
+            }
+        }
+        /*
+         * Nothing in this epoch repeats; leave the space to later epochs. A shared run of 16 bytes adds
+         * MXA_TRAIN_KMER + 1 to the score, stray hash collisions add one or two.
+         */
+        if (best_score <= window_kmers + MXA_TRAIN_KMER) continue;
+        memcpy(dict + dict_len, corpus + best, MXA_TRAIN_SEGMENT);
+        dict_len += MXA_TRAIN_SEGMENT;
+        for (size_t k = 0; k < window_kmers; ++k) {
+            counts[kmer_hash(corpus + best + k)] = 0;
+        }
+    }
+    free(counts);
+    return (long)dict_len;
+}
+
+int mxa_train_cmd(int argc, char *argv[]) {
+    size_t dict_cap = MXA_DICT_DEFAULT_SIZE;
+    int arg_offset = 1;
+    if (argc > 2 && strcmp(argv[1], "-s") == 0) {
+        char *end;
+        unsigned long requested = strtoul(argv[2], &end, 10);
+        if (*end != '\0' || requested < MXA_TRAIN_SEGMENT || requested > LZ_DICT_WINDOW_SIZE) {
+            fprintf(stderr, "%s: dictionary size must be between %d and %d bytes\n",
+                    argv[0], MXA_TRAIN_SEGMENT, LZ_DICT_WINDOW_SIZE);
+            return 1;
+        }
+        dict_cap = requested;
+        arg_offset = 3;
+    }
+    if (argc < arg_offset + 2) {
+        fprintf(stderr, "Usage: %s [-s size] <dict.mxd> <sample1> [sample2...]\n", argv[0]);
+        return 1;
+    }
+    const char *dict_path = argv[arg_offset];
+
+    int samples = argc - arg_offset - 1;
+    size_t *sample_ends = (size_t *)calloc((size_t)samples, sizeof(size_t));
+    unsigned char *corpus = NULL;
+    size_t corpus_len = 0;
+    size_t corpus_cap = 0;
+    int used = 0;
+    if (sample_ends == NULL) {
+        fprintf(stderr, "%s: out of memory\n", argv[0]);
+        return 1;
+    }
+    for (int i = arg_offset + 1; i < argc; ++i) {
+        int ret = read_file_into(argv[i], &corpus, &corpus_len, &corpus_cap);
+        if (ret < 0) {
+            free(sample_ends);
+            free(corpus);
+            return 1;
+        }
+        if (ret == 0) sample_ends[used++] = corpus_len;
+    }
+    if (corpus_len == 0) {
+        fprintf(stderr, "%s: no sample data\n", argv[0]);
+        free(sample_ends);
+        free(corpus);
+        return 1;
+    }
+
+    unsigned char *dict = (unsigned char *)malloc(dict_cap);
+    if (dict == NULL) {
+        fprintf(stderr, "%s: out of memory\n", argv[0]);
+        free(sample_ends);
+        free(corpus);
+        return 1;
+    }
+    long dict_len_long;
+    if (corpus_len <= dict_cap) {
+        memcpy(dict, corpus, corpus_len);
+        dict_len_long = (long)corpus_len;
+    } else {
+        dict_len_long = select_segments(corpus, corpus_len, sample_ends, used, dict, dict_cap);
+    }
+    free(sample_ends);
+    free(corpus);
+    if (dict_len_long <= 0) {
+        if (dict_len_long < 0) {
+            fprintf(stderr, "%s: out of memory\n", argv[0]);
+        } else {
+            fprintf(stderr, "%s: no segment repeats across the samples, nothing to train\n", argv[0]);
+        }
+        free(dict);
+        return 1;
+    }
+    size_t dict_len = (size_t)dict_len_long;
+
+    FILE *dict_fp = fopen(dict_path, "wb");
+    if (dict_fp == NULL) {
+        perror(dict_path);
+        free(dict);
+        return 1;
+    }
+    uint32_t id = mxa_dict_id(dict, dict_len);
+    fwrite(MXD_MAGIC, 1, MXD_MAGIC_LEN, dict_fp);
+    fwrite(&id, 1, MXD_ID_LEN, dict_fp);
+    fwrite(dict, 1, dict_len, dict_fp);
+    MX_STAT_ADD(MX_STAT_BYTES_WRITTEN, MXD_MAGIC_LEN + MXD_ID_LEN + dict_len);
+    free(dict);
+    if (fclose(dict_fp) != 0) {
+        perror(dict_path);
+        return 1;
+    }
+    printf("Dictionary '%s' created (%zu bytes from %d samples, id %08x).\n", dict_path, dict_len, used, id);
+    return 0;
+}
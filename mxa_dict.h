@@ -0,0 +1,43 @@
+#ifndef MXA_DICT_H
+#define MXA_DICT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define MXD_MAGIC "MXD\0"
+#define MXD_MAGIC_LEN 4
+#define MXD_ID_LEN 4
+
+#define MXA_DICT_DEFAULT_SIZE (16 * 1024)
+#define MXA_DICT_ENTRY_NAME ".mxa-dict"
+
+#define MXA_TRAIN_KMER 8
+#define MXA_TRAIN_SEGMENT 64
+#define MXA_TRAIN_HASH_BITS 20
+
+/*
+ * A dictionary is prepended to the LZ_DICT match window of every member.
+ * head/prev chain dictionary positions by their 4-byte hash (stored as
+ * position + 1, 0 ends a chain); they are only built when packing.
+ */
+struct mxa_dict {
+    unsigned char *data;
+    size_t size;
+    uint32_t id;
+    uint32_t *head;
+    uint32_t *prev;
+};
+
+static inline uint32_t lz_dict_hash(const unsigned char *p) {
+    uint32_t v = (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+    return (v * 2654435761u) >> 16;
+}
+
+uint32_t mxa_dict_id(const unsigned char *data, size_t size);
+struct mxa_dict *mxa_dict_create(const unsigned char *data, size_t size);
+struct mxa_dict *mxa_dict_load(const char *path);
+int mxa_dict_index(struct mxa_dict *dict);
+void mxa_dict_free(struct mxa_dict *dict);
+int mxa_train_cmd(int argc, char *argv[]);
+
+#endif
@@ -1,10 +1,90 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <unistd.h>
 #include <libgen.h>
 #include "mxa_functions.h"
+#include "mx_stats.h"
+#include "mxa_uring.h"
+#include "mxa_dict.h"
+
+struct mxa_codec_ctx *mxa_ctx_create(void) {
+    return (struct mxa_codec_ctx *)calloc(1, sizeof(struct mxa_codec_ctx));
+}
+
+void mxa_ctx_destroy(struct mxa_codec_ctx *ctx) {
+    if (ctx == NULL) return;
+    for (int i = 0; i < MXA_BUF_COUNT; ++i) {
+        if (ctx->buffers[i] != NULL) munmap(ctx->buffers[i], ctx->buffer_sizes[i]);
+    }
+    free(ctx->lz_head);
+    free(ctx->lz_prev);
+    free(ctx->lzd_head);
+    free(ctx->lzd_prev);
+    free(ctx);
+}
+
+/* Returns a buffer of at least size bytes, valid until the next call for the same slot. */
+unsigned char *mxa_ctx_buffer(struct mxa_codec_ctx *ctx, enum mxa_ctx_buffer which, size_t size) {
+    if (ctx->buffers[which] != NULL && size <= ctx->buffer_sizes[which]) return ctx->buffers[which];
+    size_t class_size = MXA_CTX_MIN_BUFFER;
+    while (class_size < size) {
+        if (class_size > SIZE_MAX / 2) return NULL;
+        class_size <<= 1;
+    }
+    if (ctx->buffers[which] != NULL) {
+        munmap(ctx->buffers[which], ctx->buffer_sizes[which]);
+        ctx->buffers[which] = NULL;
+        ctx->buffer_sizes[which] = 0;
+    }
+    void *buffer = mmap(NULL, class_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (buffer == MAP_FAILED) return NULL;
+    ctx->buffers[which] = (unsigned char *)buffer;
+    ctx->buffer_sizes[which] = class_size;
+    return ctx->buffers[which];
+}
+
+/*
+ * Positions in the head/prev tables are stored as base + pos + 1, so entries
+ * left over from earlier members are recognised as stale without clearing
+ * the tables. They are only wiped when base is about to wrap.
+ */
+static int prepare_tables(uint32_t **head, size_t head_size, uint32_t **prev, size_t prev_size,
+                          uint32_t *base, size_t in_len) {
+    if (*head == NULL) {
+        *head = (uint32_t *)calloc(head_size, sizeof(uint32_t));
+        *prev = (uint32_t *)calloc(prev_size, sizeof(uint32_t));
+        if (*head == NULL || *prev == NULL) {
+            free(*head);
+            free(*prev);
+            *head = NULL;
+            *prev = NULL;
+            return -1;
+        }
+        *base = 0;
+    }
+    if (in_len > UINT32_MAX - 2) return -1;
+    if (*base > UINT32_MAX - 2 - (uint32_t)in_len) {
+        memset(*head, 0, head_size * sizeof(uint32_t));
+        memset(*prev, 0, prev_size * sizeof(uint32_t));
+        *base = 0;
+    }
+    return 0;
+}
+
+int mxa_ctx_lz_tables(struct mxa_codec_ctx *ctx, size_t in_len) {
+    return prepare_tables(&ctx->lz_head, 65536, &ctx->lz_prev, LZ_LITE_PREV_SIZE, &ctx->lz_base, in_len);
+}
+
+int mxa_ctx_dict_tables(struct mxa_codec_ctx *ctx, size_t in_len) {
+    return prepare_tables(&ctx->lzd_head, LZ_DICT_HASH_SIZE, &ctx->lzd_prev, LZ_DICT_PREV_SIZE,
+                          &ctx->lzd_base, in_len);
+}
 
 long rle_compress(const unsigned char *in_buffer, size_t in_len, unsigned char *out_buffer, size_t out_len) {
     size_t in_pos = 0;
@@ -17,18 +97,19 @@ long rle_compress(const unsigned char *in_buffer, size_t in_len, unsigned char *
             repeat_count++;
             lookahead_pos++;
         }
-        if (current_byte == RLE_MARKER) {
-            if (out_pos + 2 > out_len) return -1;
-            out_buffer[out_pos++] = RLE_MARKER;
-            out_buffer[out_pos++] = 0x00;
-            in_pos += repeat_count;
-            continue;
-        }
-        if (repeat_count >= 3) {
+        /* MARKER 0x00 is the escaped marker, so zero runs stay literal. */
+        if (repeat_count >= 3 && current_byte != 0x00) {
             if (out_pos + 3 > out_len) return -1;
             out_buffer[out_pos++] = RLE_MARKER;
             out_buffer[out_pos++] = current_byte;
             out_buffer[out_pos++] = (unsigned char)repeat_count;
+        } else if (current_byte == RLE_MARKER) {
+            /* Every short-run marker byte gets its own escape. */
+            for (int i = 0; i < repeat_count; ++i) {
+                if (out_pos + 2 > out_len) return -1;
+                out_buffer[out_pos++] = RLE_MARKER;
+                out_buffer[out_pos++] = 0x00;
+            }
         } else {
             for (int i = 0; i < repeat_count; ++i) {
                 if (out_pos + 1 > out_len) return -1;
@@ -68,26 +149,49 @@ long rle_decompress(const unsigned char *in_buffer, size_t in_len, unsigned char
     return (long)out_pos;
 }
 
-long lz_lite_compress(const unsigned char *in_buffer, size_t in_len, unsigned char *out_buffer, size_t out_len) {
+static void lz_lite_insert(struct mxa_codec_ctx *ctx, const unsigned char *in_buffer, size_t pos) {
+    unsigned int key = ((unsigned int)in_buffer[pos] << 8) | in_buffer[pos + 1];
+    uint32_t abs_pos = ctx->lz_base + (uint32_t)pos + 1;
+    ctx->lz_prev[abs_pos & (LZ_LITE_PREV_SIZE - 1)] = ctx->lz_head[key];
+    ctx->lz_head[key] = abs_pos;
+}
+
+/*
+ * Same token stream as a full scan of the window: every earlier position
+ * sharing the next two bytes is chained through lz_head/lz_prev, walked
+ * nearest first, and ties go to the farthest match.
+ */
+long lz_lite_compress(struct mxa_codec_ctx *ctx, const unsigned char *in_buffer, size_t in_len,
+                      unsigned char *out_buffer, size_t out_len) {
+    if (mxa_ctx_lz_tables(ctx, in_len) != 0) return -1;
     size_t in_pos = 0;
     size_t out_pos = 0;
+    size_t next_insert = 0;
     while (in_pos < in_len) {
+        while (next_insert < in_pos) {
+            if (next_insert + 1 < in_len) lz_lite_insert(ctx, in_buffer, next_insert);
+            next_insert++;
+        }
         int best_match_len = 0;
         int best_match_offset = 0;
-        size_t search_start = (in_pos > LZ_LITE_WINDOW_SIZE) ? (in_pos - LZ_LITE_WINDOW_SIZE) : 0;
-        for (size_t i = search_start; i < in_pos; ++i) {
-            int current_match_len = 0;
-            if (in_buffer[i] == in_buffer[in_pos]) {
+        if (in_pos + 1 < in_len) {
+            unsigned int key = ((unsigned int)in_buffer[in_pos] << 8) | in_buffer[in_pos + 1];
+            uint32_t cand = ctx->lz_head[key];
+            while (cand > ctx->lz_base) {
+                size_t i = (size_t)(cand - ctx->lz_base - 1);
+                if (in_pos - i > LZ_LITE_WINDOW_SIZE) break;
+                int current_match_len = 0;
                 while (current_match_len < LZ_LITE_MAX_MATCH &&
                        (in_pos + current_match_len < in_len) &&
                        (i + current_match_len < in_pos) &&
                        (in_buffer[in_pos + current_match_len] == in_buffer[i + current_match_len])) {
                     current_match_len++;
                 }
-            }
-            if (current_match_len > best_match_len) {
-                best_match_len = current_match_len;
-                best_match_offset = in_pos - i;
+                if (current_match_len >= best_match_len) {
+                    best_match_len = current_match_len;
+                    best_match_offset = in_pos - i;
+                }
+                cand = ctx->lz_prev[cand & (LZ_LITE_PREV_SIZE - 1)];
             }
         }
         if (best_match_len >= LZ_LITE_MIN_MATCH) {
@@ -109,6 +213,7 @@ long lz_lite_compress(const unsigned char *in_buffer, size_t in_len, unsigned ch
             in_pos++;
         }
     }
+    ctx->lz_base += (uint32_t)in_len + 1;
     return (long)out_pos;
 }
 
@@ -146,142 +251,395 @@ long lz_lite_decompress(const unsigned char *in_buffer, size_t in_len, unsigned
     return (long)out_pos;
 }
 
+static void lz_dict_insert(struct mxa_codec_ctx *ctx, const unsigned char *in_buffer, size_t pos) {
+    uint32_t h = lz_dict_hash(in_buffer + pos);
+    uint32_t abs_pos = ctx->lzd_base + (uint32_t)pos + 1;
+    ctx->lzd_prev[abs_pos & (LZ_DICT_PREV_SIZE - 1)] = ctx->lzd_head[h];
+    ctx->lzd_head[h] = abs_pos;
+}
+
+static size_t match_length(const unsigned char *a, const unsigned char *b, size_t limit) {
+    size_t len = 0;
+    while (len < limit && a[len] == b[len]) len++;
+    return len;
+}
+
+/*
+ * Greedy LZ over a 64 KiB window that starts with ctx->dict, if any. Earlier
+ * positions of the member and of the dictionary are found through separate
+ * 4-byte hash chains, each walked at most LZ_DICT_CHAIN_DEPTH deep; matches
+ * never run from the dictionary into the member.
+ */
+long lz_dict_compress(struct mxa_codec_ctx *ctx, const unsigned char *in_buffer, size_t in_len,
+                      unsigned char *out_buffer, size_t out_len) {
+    if (mxa_ctx_dict_tables(ctx, in_len) != 0) return -1;
+    const struct mxa_dict *dict = ctx->dict;
+    size_t in_pos = 0;
+    size_t out_pos = 0;
+    size_t next_insert = 0;
+    while (in_pos < in_len) {
+        while (next_insert < in_pos) {
+            if (next_insert + 4 <= in_len) lz_dict_insert(ctx, in_buffer, next_insert);
+            next_insert++;
+        }
+        size_t best_match_len = 0;
+        size_t best_match_offset = 0;
+        if (in_pos + LZ_DICT_MIN_MATCH <= in_len) {
+            size_t limit = in_len - in_pos < LZ_DICT_MAX_MATCH ? in_len - in_pos : LZ_DICT_MAX_MATCH;
+            uint32_t h = lz_dict_hash(in_buffer + in_pos);
+            uint32_t cand = ctx->lzd_head[h];
+            for (int depth = 0; cand > ctx->lzd_base && depth < LZ_DICT_CHAIN_DEPTH; ++depth) {
+                size_t i = (size_t)(cand - ctx->lzd_base - 1);
+                if (in_pos - i > LZ_DICT_WINDOW_SIZE) break;
+                size_t len = match_length(in_buffer + i, in_buffer + in_pos, limit);
+                if (len > best_match_len) {
+                    best_match_len = len;
+                    best_match_offset = in_pos - i;
+                    if (len == limit) break;
+                }
+                cand = ctx->lzd_prev[cand & (LZ_DICT_PREV_SIZE - 1)];
+            }
+            uint32_t dict_cand = dict != NULL && best_match_len < limit ? dict->head[h] : 0;
+            for (int depth = 0; dict_cand != 0 && depth < LZ_DICT_CHAIN_DEPTH; ++depth) {
+                size_t pos = dict_cand - 1;
+                size_t offset = dict->size - pos + in_pos;
+                if (offset > LZ_DICT_WINDOW_SIZE) break;
+                size_t dict_limit = dict->size - pos < limit ? dict->size - pos : limit;
+                size_t len = match_length(dict->data + pos, in_buffer + in_pos, dict_limit);
+                if (len > best_match_len) {
+                    best_match_len = len;
+                    best_match_offset = offset;
+                    if (len == limit) break;
+                }
+                dict_cand = dict->prev[pos];
+            }
+        }
+        if (best_match_len >= LZ_DICT_MIN_MATCH) {
+            if (out_pos + 4 > out_len) return -1;
+            out_buffer[out_pos++] = LZ_DICT_MARKER;
+            out_buffer[out_pos++] = (unsigned char)(best_match_len - LZ_DICT_MIN_MATCH + 1);
+            out_buffer[out_pos++] = (unsigned char)(best_match_offset & 0xFF);
+            out_buffer[out_pos++] = (unsigned char)(best_match_offset >> 8);
+            in_pos += best_match_len;
+        } else {
+            unsigned char current_byte = in_buffer[in_pos];
+            if (current_byte == LZ_DICT_MARKER) {
+                if (out_pos + 2 > out_len) return -1;
+                out_buffer[out_pos++] = LZ_DICT_MARKER;
+                out_buffer[out_pos++] = 0x00;
+            } else {
+                if (out_pos + 1 > out_len) return -1;
+                out_buffer[out_pos++] = current_byte;
+            }
+            in_pos++;
+        }
+    }
+    ctx->lzd_base += (uint32_t)in_len + 1;
+    return (long)out_pos;
+}
+
+long lz_dict_decompress(const struct mxa_dict *dict, const unsigned char *in_buffer, size_t in_len,
+                        unsigned char *out_buffer, size_t out_len) {
+    size_t dict_size = dict != NULL ? dict->size : 0;
+    size_t in_pos = 0;
+    size_t out_pos = 0;
+    while (in_pos < in_len) {
+        unsigned char current_byte = in_buffer[in_pos++];
+        if (current_byte != LZ_DICT_MARKER) {
+            if (out_pos + 1 > out_len) return -1;
+            out_buffer[out_pos++] = current_byte;
+            continue;
+        }
+        if (in_pos >= in_len) return -1;
+        unsigned char length_code = in_buffer[in_pos++];
+        if (length_code == 0x00) {
+            if (out_pos + 1 > out_len) return -1;
+            out_buffer[out_pos++] = LZ_DICT_MARKER;
+            continue;
+        }
+        if (in_pos + 2 > in_len) return -1;
+        size_t offset = (size_t)in_buffer[in_pos] | (size_t)in_buffer[in_pos + 1] << 8;
+        in_pos += 2;
+        size_t length = (size_t)length_code + LZ_DICT_MIN_MATCH - 1;
+        if (offset == 0 || offset > out_pos + dict_size) return -1;
+        if (out_pos + length > out_len) return -1;
+        /* Source position in the virtual window dict || output. */
+        size_t src = dict_size + out_pos - offset;
+        for (size_t i = 0; i < length; ++i, ++src) {
+            out_buffer[out_pos++] = src < dict_size ? dict->data[src] : out_buffer[src - dict_size];
+        }
+    }
+    return (long)out_pos;
+}
+
+static const char *mode_name(unsigned char compression_mode) {
+    switch (compression_mode) {
+        case COMPRESSION_NONE: return "NONE";
+        case COMPRESSION_RLE: return "RLE";
+        case COMPRESSION_LZ_LITE: return "LZ_LITE";
+        case COMPRESSION_LZ_DICT: return "LZ_DICT";
+        case COMPRESSION_DICT_ENTRY: return "DICT";
+        default: return "UNKNOWN";
+    }
+}
+
+/* Returns 0 when the entry was written or skipped, 1 when packing has to stop. */
+static int pack_member(struct mxa_codec_ctx *ctx, FILE *archive_fp, const char *file_name,
+                       unsigned char *file_data, size_t original_file_size, unsigned char compression_mode) {
+    size_t temp_name_len = strlen(file_name);
+    if (temp_name_len == 0 || temp_name_len > 255) {
+        fprintf(stderr, "%s: filename too long or empty, skipping.\n", file_name);
+        return 0;
+    }
+    unsigned char name_len = (unsigned char)temp_name_len;
+
+    unsigned char *output_data = NULL;
+    long compressed_size_long = original_file_size;
+    size_t max_compressed_size_estimate = original_file_size * 2 + 1024;
+
+    if (compression_mode == COMPRESSION_RLE) {
+        output_data = mxa_ctx_buffer(ctx, MXA_BUF_OUTPUT, max_compressed_size_estimate);
+        if (output_data == NULL) {
+            fprintf(stderr, "mxa_pack: Out of memory for RLE output.\n");
+            return 1;
+        }
+        uint64_t codec_start = mx_stats_mode ? mx_stats_now_ns() : 0;
+        compressed_size_long = rle_compress(file_data, original_file_size, output_data, max_compressed_size_estimate);
+        if (mx_stats_mode) mx_stats_add(MX_STAT_RLE_NS, mx_stats_now_ns() - codec_start);
+        MX_STAT_ADD(MX_STAT_BLOCKS_COMPRESSED, 1);
+        if (compressed_size_long == -1) {
+            fprintf(stderr, "mxa_pack: RLE compression error for %s.\n", file_name);
+            return 1;
+        }
+    } else if (compression_mode == COMPRESSION_LZ_LITE) {
+        output_data = mxa_ctx_buffer(ctx, MXA_BUF_OUTPUT, max_compressed_size_estimate);
+        if (output_data == NULL) {
+            fprintf(stderr, "mxa_pack: Out of memory for LZ_LITE output.\n");
+            return 1;
+        }
+        uint64_t codec_start = mx_stats_mode ? mx_stats_now_ns() : 0;
+        compressed_size_long = lz_lite_compress(ctx, file_data, original_file_size, output_data, max_compressed_size_estimate);
+        if (mx_stats_mode) mx_stats_add(MX_STAT_LZ_LITE_NS, mx_stats_now_ns() - codec_start);
+        MX_STAT_ADD(MX_STAT_BLOCKS_COMPRESSED, 1);
+        if (compressed_size_long == -1) {
+            fprintf(stderr, "mxa_pack: LZ_LITE compression error for %s.\n", file_name);
+            return 1;
+        }
+    } else if (compression_mode == COMPRESSION_LZ_DICT) {
+        output_data = mxa_ctx_buffer(ctx, MXA_BUF_OUTPUT, max_compressed_size_estimate);
+        if (output_data == NULL) {
+            fprintf(stderr, "mxa_pack: Out of memory for LZ_DICT output.\n");
+            return 1;
+        }
+        uint64_t codec_start = mx_stats_mode ? mx_stats_now_ns() : 0;
+        compressed_size_long = lz_dict_compress(ctx, file_data, original_file_size, output_data, max_compressed_size_estimate);
+        if (mx_stats_mode) mx_stats_add(MX_STAT_LZ_DICT_NS, mx_stats_now_ns() - codec_start);
+        MX_STAT_ADD(MX_STAT_BLOCKS_COMPRESSED, 1);
+        if (compressed_size_long == -1) {
+            fprintf(stderr, "mxa_pack: LZ_DICT compression error for %s.\n", file_name);
+            return 1;
+        }
+    } else {
+        output_data = file_data;
+    }
+
+    size_t compressed_size = (size_t)compressed_size_long;
+
+    fwrite(&name_len, 1, FILENAME_LEN_BYTE, archive_fp);
+    fwrite(file_name, 1, name_len, archive_fp);
+    fwrite(&compressed_size, 1, FILESIZE_LEN_BYTE, archive_fp);
+    fwrite(&compression_mode, 1, COMPRESSION_FLAG_BYTE, archive_fp);
+    fwrite(output_data, 1, compressed_size, archive_fp);
+    MX_STAT_ADD(MX_STAT_BYTES_WRITTEN, FILENAME_LEN_BYTE + name_len + FILESIZE_LEN_BYTE + COMPRESSION_FLAG_BYTE + compressed_size);
+
+    printf("Packed: %s (original: %zu bytes, compressed: %zu bytes, mode: %s)\n",
+           file_name, original_file_size, compressed_size, mode_name(compression_mode));
+    return 0;
+}
+
+static int pack_file(struct mxa_codec_ctx *ctx, FILE *archive_fp, char *file_path, unsigned char compression_mode) {
+    /* O_NONBLOCK so a FIFO opens at once and is turned away by the type check instead of waiting for a writer. */
+    int fd = open(file_path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0) {
+        perror(file_path);
+        return 1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        perror(file_path);
+        close(fd);
+        return 1;
+    }
+    if (!S_ISREG(st.st_mode)) {
+        fprintf(stderr, "%s: not a regular file, skipping.\n", file_path);
+        close(fd);
+        return 0;
+    }
+    size_t original_file_size = st.st_size;
+
+    unsigned char *file_data = mxa_ctx_buffer(ctx, MXA_BUF_INPUT, original_file_size);
+    if (file_data == NULL) {
+        fprintf(stderr, "mxa_pack: Out of memory for file data.\n");
+        close(fd);
+        return 1;
+    }
+    size_t done = 0;
+    while (done < original_file_size) {
+        ssize_t n = read(fd, file_data + done, original_file_size - done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            fprintf(stderr, "mxa_pack: Error reading file %s.\n", file_path);
+            close(fd);
+            return 1;
+        }
+        done += (size_t)n;
+    }
+    close(fd);
+    MX_STAT_ADD(MX_STAT_BYTES_READ, original_file_size);
+
+    return pack_member(ctx, archive_fp, basename(file_path), file_data, original_file_size, compression_mode);
+}
+
+/* Reads up to MXA_URING_BATCH members with one io_uring submission; large or failed ones go through pack_file. */
+static int pack_files_uring(struct mxa_codec_ctx *ctx, struct mxa_uring *ring, FILE *archive_fp,
+                            char **paths, int count, unsigned char compression_mode) {
+    struct mxa_uring_file files[MXA_URING_BATCH];
+    for (int i = 0; i < count; ++i) {
+        files[i].path = paths[i];
+    }
+    if (mxa_uring_read_files(ring, files, (unsigned int)count) != 0) {
+        for (int i = 0; i < count; ++i) {
+            if (pack_file(ctx, archive_fp, paths[i], compression_mode) != 0) return 1;
+        }
+        return 0;
+    }
+    for (int i = 0; i < count; ++i) {
+        int ret;
+        if (files[i].err == 0) {
+            MX_STAT_ADD(MX_STAT_BYTES_READ, files[i].size);
+            ret = pack_member(ctx, archive_fp, basename(paths[i]), mxa_uring_slot(ring, (unsigned int)i),
+                              files[i].size, compression_mode);
+        } else if (files[i].mode != 0 && !S_ISREG(files[i].mode)) {
+            fprintf(stderr, "%s: not a regular file, skipping.\n", paths[i]);
+            ret = 0;
+        } else {
+            ret = pack_file(ctx, archive_fp, paths[i], compression_mode);
+        }
+        if (ret != 0) return 1;
+    }
+    return 0;
+}
+
+static int use_uring(int members) {
+    const char *io = getenv("MXA_IO");
+    return members > 1 && (io == NULL || strcmp(io, "sync") != 0);
+}
+
+/* Stored ahead of the members that use it: the dictionary ID, then its content. */
+static void pack_dict_entry(FILE *archive_fp, const struct mxa_dict *dict) {
+    unsigned char name_len = (unsigned char)strlen(MXA_DICT_ENTRY_NAME);
+    size_t entry_size = MXD_ID_LEN + dict->size;
+    unsigned char compression_mode = COMPRESSION_DICT_ENTRY;
+    fwrite(&name_len, 1, FILENAME_LEN_BYTE, archive_fp);
+    fwrite(MXA_DICT_ENTRY_NAME, 1, name_len, archive_fp);
+    fwrite(&entry_size, 1, FILESIZE_LEN_BYTE, archive_fp);
+    fwrite(&compression_mode, 1, COMPRESSION_FLAG_BYTE, archive_fp);
+    fwrite(&dict->id, 1, MXD_ID_LEN, archive_fp);
+    fwrite(dict->data, 1, dict->size, archive_fp);
+    MX_STAT_ADD(MX_STAT_BYTES_WRITTEN, FILENAME_LEN_BYTE + name_len + FILESIZE_LEN_BYTE + COMPRESSION_FLAG_BYTE + entry_size);
+    printf("Dictionary: id %08x (%zu bytes)\n", dict->id, dict->size);
+}
+
 int mxa_pack_cmd(int argc, char *argv[]) {
     if (argc < 2) {
-        fprintf(stderr, "Usage: %s [-n|-m|-d] <archive_name.mxa> <file1> [file2...]\n", argv[0]);
+        fprintf(stderr, "Usage: %s [-n|-m|-d|-D dict.mxd] <archive_name.mxa> <file1> [file2...]\n", argv[0]);
         return 1;
     }
     int arg_offset = 1;
     unsigned char compression_mode = COMPRESSION_NONE;
-    if (argv[1][0] == '-') {
-        if (strcmp(argv[1], "-n") == 0) {
+    const char *dict_path = NULL;
+    const char *codec_option = NULL;
+    while (arg_offset < argc && argv[arg_offset][0] == '-') {
+        const char *option = argv[arg_offset];
+        if (strcmp(option, "-n") == 0) {
             compression_mode = COMPRESSION_NONE;
-            arg_offset++;
-        } else if (strcmp(argv[1], "-m") == 0) {
+            codec_option = option;
+        } else if (strcmp(option, "-m") == 0) {
             compression_mode = COMPRESSION_RLE;
-            arg_offset++;
-        } else if (strcmp(argv[1], "-d") == 0) {
+            codec_option = option;
+        } else if (strcmp(option, "-d") == 0) {
             compression_mode = COMPRESSION_LZ_LITE;
-            arg_offset++;
+            codec_option = option;
+        } else if (strcmp(option, "-D") == 0 && arg_offset + 1 < argc) {
+            dict_path = argv[++arg_offset];
         } else {
-            fprintf(stderr, "%s: Unknown option '%s'\n", argv[0], argv[1]);
+            fprintf(stderr, "%s: Unknown option '%s'\n", argv[0], option);
             return 1;
         }
+        arg_offset++;
     }
 
     if (argc < arg_offset + 2) {
-        fprintf(stderr, "Usage: %s [-n|-m|-d] <archive_name.mxa> <file1> [file2...]\n", argv[0]);
+        fprintf(stderr, "Usage: %s [-n|-m|-d|-D dict.mxd] <archive_name.mxa> <file1> [file2...]\n", argv[0]);
+        return 1;
+    }
+    if (dict_path != NULL && codec_option != NULL) {
+        fprintf(stderr, "%s: -D cannot be combined with %s\n", argv[0], codec_option);
         return 1;
     }
+    struct mxa_dict *dict = NULL;
+    if (dict_path != NULL) {
+        dict = mxa_dict_load(dict_path);
+        if (dict == NULL) return 1;
+        if (mxa_dict_index(dict) != 0) {
+            fprintf(stderr, "mxa_pack: Out of memory for dictionary index.\n");
+            mxa_dict_free(dict);
+            return 1;
+        }
+        compression_mode = COMPRESSION_LZ_DICT;
+    }
     char *archive_name = argv[arg_offset];
     FILE *archive_fp = fopen(archive_name, "wb");
     if (archive_fp == NULL) {
         perror("mxa_pack: failed to open archive file");
+        mxa_dict_free(dict);
         return 1;
     }
-    fwrite(MXA_MAGIC, 1, MXA_MAGIC_LEN, archive_fp);
-    for (int i = arg_offset + 1; i < argc; ++i) {
-        char *file_path = argv[i];
-        char *file_name = basename(file_path);
-        struct stat st;
-        if (stat(file_path, &st) != 0) {
-            perror(file_path);
-            fclose(archive_fp);
-            return 1;
-        }
-        if (!S_ISREG(st.st_mode)) {
-            fprintf(stderr, "%s: not a regular file, skipping.\n", file_path);
-            continue;
-        }
-        size_t original_file_size = st.st_size;
-        size_t temp_name_len = strlen(file_name);
-        if (temp_name_len == 0 || temp_name_len > 255) {
-            fprintf(stderr, "%s: filename too long or empty, skipping.\n", file_name);
-            continue;
-        }
-        unsigned char name_len = (unsigned char)temp_name_len;
+    fwrite(dict != NULL ? MXA_MAGIC_DICT : MXA_MAGIC, 1, MXA_MAGIC_LEN, archive_fp);
+    if (dict != NULL) pack_dict_entry(archive_fp, dict);
 
-        FILE *input_fp = fopen(file_path, "rb");
-        if (input_fp == NULL) {
-            perror(file_path);
-            fclose(archive_fp);
-            return 1;
-        }
-        unsigned char *file_data = (unsigned char *)malloc(original_file_size);
-        if (file_data == NULL) {
-            fprintf(stderr, "mxa_pack: Out of memory for file data.\n");
-            fclose(input_fp);
-            fclose(archive_fp);
-            return 1;
-        }
-        if (fread(file_data, 1, original_file_size, input_fp) != original_file_size) {
-            fprintf(stderr, "mxa_pack: Error reading file %s.\n", file_path);
-            free(file_data);
-            fclose(input_fp);
-            fclose(archive_fp);
-            return 1;
-        }
-        fclose(input_fp);
-        unsigned char *output_data = NULL;
-        long compressed_size_long = original_file_size;
-        size_t max_compressed_size_estimate = original_file_size * 2 + 1024;
-        
-        if (compression_mode == COMPRESSION_RLE) {
-            output_data = (unsigned char *)malloc(max_compressed_size_estimate);
-            if (output_data == NULL) {
-                fprintf(stderr, "mxa_pack: Out of memory for RLE output.\n");
-                free(file_data); fclose(archive_fp); return 1;
-            }
-            compressed_size_long = rle_compress(file_data, original_file_size, output_data, max_compressed_size_estimate);
-            if (compressed_size_long == -1) {
-                fprintf(stderr, "mxa_pack: RLE compression error for %s.\n", file_name);
-                free(file_data); free(output_data); fclose(archive_fp); return 1;
-            }
-        } else if (compression_mode == COMPRESSION_LZ_LITE) {
-            output_data = (unsigned char *)malloc(max_compressed_size_estimate);
-            if (output_data == NULL) {
-                fprintf(stderr, "mxa_pack: Out of memory for LZ_LITE output.\n");
-                free(file_data); fclose(archive_fp); return 1;
-            }
-            compressed_size_long = lz_lite_compress(file_data, original_file_size, output_data, max_compressed_size_estimate);
-            if (compressed_size_long == -1) {
-                fprintf(stderr, "mxa_pack: LZ_LITE compression error for %s.\n", file_name);
-                free(file_data); free(output_data); fclose(archive_fp); return 1;
-            }
+    struct mxa_codec_ctx *ctx = mxa_ctx_create();
+    if (ctx == NULL) {
+        fprintf(stderr, "mxa_pack: Out of memory for codec context.\n");
+        fclose(archive_fp);
+        mxa_dict_free(dict);
+        return 1;
+    }
+    ctx->dict = dict;
+    int first = arg_offset + 1;
+    struct mxa_uring *ring = use_uring(argc - first) ? mxa_uring_create() : NULL;
+    for (int i = first; i < argc;) {
+        int ret;
+        if (ring != NULL) {
+            int count = argc - i < MXA_URING_BATCH ? argc - i : MXA_URING_BATCH;
+            ret = pack_files_uring(ctx, ring, archive_fp, argv + i, count, compression_mode);
+            i += count;
         } else {
-            output_data = file_data;
+            ret = pack_file(ctx, archive_fp, argv[i], compression_mode);
+            i++;
         }
-
-        size_t compressed_size = (size_t)compressed_size_long;
-
-        if (output_data == NULL || compressed_size_long == -1) {
-            fprintf(stderr, "mxa_pack: Compression/memory error for %s.\n", file_name);
-            if (file_data) free(file_data);
-            if (output_data != file_data && output_data) free(output_data);
+        if (ret != 0) {
+            mxa_uring_destroy(ring);
+            mxa_ctx_destroy(ctx);
+            mxa_dict_free(dict);
             fclose(archive_fp);
             return 1;
         }
-
-        fwrite(&name_len, 1, FILENAME_LEN_BYTE, archive_fp);
-        fwrite(file_name, 1, name_len, archive_fp);
-        fwrite(&compressed_size, 1, FILESIZE_LEN_BYTE, archive_fp);
-        fwrite(&compression_mode, 1, COMPRESSION_FLAG_BYTE, archive_fp);
-        fwrite(output_data, 1, compressed_size, archive_fp);
-        
-        const char* mode_str;
-        switch (compression_mode) {
-            case COMPRESSION_NONE: mode_str = "NONE"; break;
-            case COMPRESSION_RLE: mode_str = "RLE"; break;
-            case COMPRESSION_LZ_LITE: mode_str = "LZ_LITE"; break;
-            default: mode_str = "UNKNOWN"; break;
-        }
-        printf("Packed: %s (original: %zu bytes, compressed: %zu bytes, mode: %s)\n",
-               file_name, original_file_size, compressed_size, mode_str);
-        if (compression_mode != COMPRESSION_NONE) {
-            free(output_data);
-        }
-        free(file_data);
     }
+    mxa_uring_destroy(ring);
+    mxa_ctx_destroy(ctx);
+    mxa_dict_free(dict);
+
     unsigned char end_marker = 0x00;
     fwrite(&end_marker, 1, FILENAME_LEN_BYTE, archive_fp);
     fclose(archive_fp);
@@ -289,6 +647,63 @@ int mxa_pack_cmd(int argc, char *argv[]) {
     return 0;
 }
 
+static void write_output(const char *file_name, const unsigned char *output_data, size_t decompressed_size,
+                         unsigned char compression_mode) {
+    int fd = open(file_name, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    if (fd < 0) {
+        perror(file_name);
+        return;
+    }
+    size_t done = 0;
+    while (done < decompressed_size) {
+        ssize_t n = write(fd, output_data + done, decompressed_size - done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) {
+            perror(file_name);
+            close(fd);
+            return;
+        }
+        done += (size_t)n;
+    }
+    close(fd);
+    MX_STAT_ADD(MX_STAT_BYTES_WRITTEN, decompressed_size);
+    printf("Extracted: %s (original: %zu bytes, mode: %s)\n",
+           file_name, decompressed_size, mode_name(compression_mode));
+}
+
+/* Largest output any well-formed member can decode to: every match token at its longest. */
+static size_t decoded_bound(unsigned char compression_mode, size_t compressed_size) {
+    if (compression_mode == COMPRESSION_NONE) return compressed_size;
+    if (compression_mode == COMPRESSION_LZ_DICT) return compressed_size / 4 * LZ_DICT_MAX_MATCH + compressed_size % 4;
+    return compressed_size / 3 * 255 + compressed_size % 3;
+}
+
+static long decode_member(struct mxa_codec_ctx *ctx, unsigned char compression_mode, const unsigned char *input_data,
+                          size_t compressed_size, unsigned char *output_data, size_t output_len) {
+    long decompressed_size_long = -1;
+    uint64_t codec_start = mx_stats_mode ? mx_stats_now_ns() : 0;
+    switch (compression_mode) {
+        case COMPRESSION_RLE:
+            decompressed_size_long = rle_decompress(input_data, compressed_size, output_data, output_len);
+            if (mx_stats_mode) mx_stats_add(MX_STAT_RLE_NS, mx_stats_now_ns() - codec_start);
+            break;
+        case COMPRESSION_LZ_LITE:
+            decompressed_size_long = lz_lite_decompress(input_data, compressed_size, output_data, output_len);
+            if (mx_stats_mode) mx_stats_add(MX_STAT_LZ_LITE_NS, mx_stats_now_ns() - codec_start);
+            break;
+        case COMPRESSION_LZ_DICT:
+            decompressed_size_long = lz_dict_decompress(ctx->dict, input_data, compressed_size, output_data, output_len);
+            if (mx_stats_mode) mx_stats_add(MX_STAT_LZ_DICT_NS, mx_stats_now_ns() - codec_start);
+            break;
+        case COMPRESSION_NONE:
+            if (compressed_size > output_len) break;
+            if (output_data != input_data) memcpy(output_data, input_data, compressed_size);
+            decompressed_size_long = (long)compressed_size;
+            break;
+    }
+    return decompressed_size_long;
+}
+
 int mxa_unpack_cmd(int argc, char *argv[]) {
     if (argc < 2) {
         fprintf(stderr, "Usage: %s <archive_name.mxa>\n", argv[0]);
@@ -302,119 +717,133 @@ int mxa_unpack_cmd(int argc, char *argv[]) {
     }
     char magic_buffer[MXA_MAGIC_LEN];
     if (fread(magic_buffer, 1, MXA_MAGIC_LEN, archive_fp) != MXA_MAGIC_LEN ||
-        memcmp(magic_buffer, MXA_MAGIC, MXA_MAGIC_LEN) != 0) {
+        (memcmp(magic_buffer, MXA_MAGIC, MXA_MAGIC_LEN) != 0 &&
+         memcmp(magic_buffer, MXA_MAGIC_DICT, MXA_MAGIC_LEN) != 0)) {
         fprintf(stderr, "mxa_unpack: Not a valid .mxa archive: %s\n", archive_name);
         fclose(archive_fp);
         return 1;
     }
     printf("Extracting from archive: %s\n", archive_name);
+
+    struct mxa_codec_ctx *ctx = mxa_ctx_create();
+    if (ctx == NULL) {
+        fprintf(stderr, "mxa_unpack: Out of memory for codec context.\n");
+        fclose(archive_fp);
+        return 1;
+    }
+    struct mxa_dict *dict = NULL;
+
     unsigned char name_len;
     size_t compressed_size;
     unsigned char compression_mode;
     char file_name[256];
+    int status = 0;
     while (fread(&name_len, 1, FILENAME_LEN_BYTE, archive_fp) == FILENAME_LEN_BYTE && name_len != 0) {
         if (fread(file_name, 1, name_len, archive_fp) != name_len) {
             fprintf(stderr, "mxa_unpack: Error reading filename.\n");
-            fclose(archive_fp);
-            return 1;
+            status = 1;
+            break;
         }
         file_name[name_len] = '\0';
+        compressed_size = 0;
         if (fread(&compressed_size, 1, FILESIZE_LEN_BYTE, archive_fp) != FILESIZE_LEN_BYTE) {
             fprintf(stderr, "mxa_unpack: Error reading compressed size for %s.\n", file_name);
-            fclose(archive_fp);
-            return 1;
+            status = 1;
+            break;
         }
         if (fread(&compression_mode, 1, COMPRESSION_FLAG_BYTE, archive_fp) != COMPRESSION_FLAG_BYTE) {
             fprintf(stderr, "mxa_unpack: Error reading compression flag for %s.\n", file_name);
-            fclose(archive_fp);
-            return 1;
+            status = 1;
+            break;
         }
-        unsigned char *input_data = (unsigned char *)malloc(compressed_size);
+        unsigned char *input_data = mxa_ctx_buffer(ctx, MXA_BUF_INPUT, compressed_size);
         if (input_data == NULL) {
             fprintf(stderr, "mxa_unpack: Out of memory for input data.\n");
-            fclose(archive_fp);
-            return 1;
+            status = 1;
+            break;
         }
+        MX_STAT_ADD(MX_STAT_BYTES_READ, compressed_size);
         if (fread(input_data, 1, compressed_size, archive_fp) != compressed_size) {
             fprintf(stderr, "mxa_unpack: Error reading file data for %s.\n", file_name);
-            free(input_data);
-            fclose(archive_fp);
-            return 1;
+            status = 1;
+            break;
         }
-        FILE *output_fp = fopen(file_name, "wb");
-        if (output_fp == NULL) {
-            perror(file_name);
-            free(input_data);
-            continue;
-        }
-        unsigned char *output_data = NULL;
-        long decompressed_size_long = 0;
-        size_t max_decompressed_size_estimate = compressed_size * 4 + 1024;
-        
-        switch (compression_mode) {
-            case COMPRESSION_RLE:
-                output_data = (unsigned char *)malloc(max_decompressed_size_estimate);
-                if (output_data == NULL) {
-                    fprintf(stderr, "mxa_unpack: Out of memory for RLE decomp.\n");
-                    free(input_data); fclose(output_fp); fclose(archive_fp); return 1;
-                }
-                decompressed_size_long = rle_decompress(input_data, compressed_size, output_data, max_decompressed_size_estimate);
-                if (decompressed_size_long == -1) {
-                    fprintf(stderr, "mxa_unpack: RLE decompression error for %s.\n", file_name);
-                    free(input_data); free(output_data); fclose(output_fp); fclose(archive_fp); return 1;
-                }
-                break;
-            case COMPRESSION_LZ_LITE:
-                output_data = (unsigned char *)malloc(max_decompressed_size_estimate);
-                if (output_data == NULL) {
-                    fprintf(stderr, "mxa_unpack: Out of memory for LZ_LITE decomp.\n");
-                    free(input_data); fclose(output_fp); fclose(archive_fp); return 1;
-                }
-                decompressed_size_long = lz_lite_decompress(input_data, compressed_size, output_data, max_decompressed_size_estimate);
-                if (decompressed_size_long == -1) {
-                    fprintf(stderr, "mxa_unpack: LZ_LITE decompression error for %s.\n", file_name);
-                    free(input_data); free(output_data); fclose(output_fp); fclose(archive_fp); return 1;
-                }
+        if (compression_mode == COMPRESSION_DICT_ENTRY) {
+            uint32_t id = 0;
+            if (compressed_size >= MXD_ID_LEN) memcpy(&id, input_data, MXD_ID_LEN);
+            if (compressed_size < MXD_ID_LEN || compressed_size - MXD_ID_LEN > LZ_DICT_WINDOW_SIZE ||
+                id != mxa_dict_id(input_data + MXD_ID_LEN, compressed_size - MXD_ID_LEN)) {
+                fprintf(stderr, "mxa_unpack: Corrupt dictionary in %s.\n", archive_name);
+                status = 1;
                 break;
-            case COMPRESSION_NONE:
-                output_data = input_data;
-                decompressed_size_long = compressed_size;
+            }
+            mxa_dict_free(dict);
+            dict = mxa_dict_create(input_data + MXD_ID_LEN, compressed_size - MXD_ID_LEN);
+            if (dict == NULL) {
+                fprintf(stderr, "mxa_unpack: Out of memory for dictionary.\n");
+                status = 1;
                 break;
-            default:
-                fprintf(stderr, "mxa_unpack: Unknown compression mode 0x%02x for %s. Skipping.\n", compression_mode, file_name);
-                free(input_data);
-                fclose(output_fp);
-                continue;
+            }
+            ctx->dict = dict;
+            continue;
+        }
+        if (compression_mode == COMPRESSION_LZ_DICT && dict == NULL) {
+            fprintf(stderr, "mxa_unpack: No dictionary in archive for %s.\n", file_name);
+            status = 1;
+            break;
+        }
+        if (compression_mode != COMPRESSION_NONE && compression_mode != COMPRESSION_RLE &&
+            compression_mode != COMPRESSION_LZ_LITE && compression_mode != COMPRESSION_LZ_DICT) {
+            fprintf(stderr, "mxa_unpack: Unknown compression mode 0x%02x for %s. Skipping.\n", compression_mode, file_name);
+            continue;
         }
 
-        size_t decompressed_size = (size_t)decompressed_size_long;
+        size_t max_decompressed_size_estimate = compressed_size * 4 + 1024;
+        size_t bound = decoded_bound(compression_mode, compressed_size);
+        if (max_decompressed_size_estimate > bound) max_decompressed_size_estimate = bound;
 
-        if (output_data == NULL || decompressed_size_long == -1) {
-            fprintf(stderr, "mxa_unpack: Decompression/memory error for %s.\n", file_name);
-            if (input_data) free(input_data);
-            if (output_data != input_data && output_data) free(output_data);
-            fclose(output_fp);
-            fclose(archive_fp);
-            return 1;
+        unsigned char *output_data;
+        size_t output_len;
+        if (compression_mode == COMPRESSION_NONE) {
+            output_data = input_data;
+            output_len = compressed_size;
+        } else {
+            output_len = max_decompressed_size_estimate;
+            output_data = mxa_ctx_buffer(ctx, MXA_BUF_OUTPUT, output_len);
+            if (output_data == NULL) {
+                fprintf(stderr, "mxa_unpack: Out of memory for %s decomp.\n", mode_name(compression_mode));
+                status = 1;
+                break;
+            }
         }
 
-        fwrite(output_data, 1, decompressed_size, output_fp);
-        fclose(output_fp);
-        const char* mode_str;
-        switch (compression_mode) {
-            case COMPRESSION_NONE: mode_str = "NONE"; break;
-            case COMPRESSION_RLE: mode_str = "RLE"; break;
-            case COMPRESSION_LZ_LITE: mode_str = "LZ_LITE"; break;
-            default: mode_str = "UNKNOWN"; break;
+        long decompressed_size_long = decode_member(ctx, compression_mode, input_data, compressed_size,
+                                                    output_data, output_len);
+        if (decompressed_size_long == -1 && output_len < bound) {
+            /* Better than 4:1: retry once with room for the worst case. */
+            output_len = bound;
+            output_data = mxa_ctx_buffer(ctx, MXA_BUF_OUTPUT, output_len);
+            if (output_data == NULL) {
+                fprintf(stderr, "mxa_unpack: Out of memory for %s decomp.\n", mode_name(compression_mode));
+                status = 1;
+                break;
+            }
+            decompressed_size_long = decode_member(ctx, compression_mode, input_data, compressed_size,
+                                                   output_data, output_len);
         }
-        printf("Extracted: %s (original: %zu bytes, mode: %s)\n",
-               file_name, decompressed_size, mode_str);
-        if (compression_mode != COMPRESSION_NONE) {
-            free(output_data);
+        if (decompressed_size_long == -1) {
+            fprintf(stderr, "mxa_unpack: %s decompression error for %s.\n", mode_name(compression_mode), file_name);
+            status = 1;
+            break;
         }
-        free(input_data);
+        size_t decompressed_size = (size_t)decompressed_size_long;
+
+        write_output(file_name, output_data, decompressed_size, compression_mode);
     }
+    mxa_ctx_destroy(ctx);
+    mxa_dict_free(dict);
     fclose(archive_fp);
+    if (status != 0) return status;
     printf("Extraction complete.\n");
     return 0;
 }
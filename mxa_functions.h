@@ -1,7 +1,12 @@
 #ifndef MXA_FUNCTIONS_H
 #define MXA_FUNCTIONS_H
 
+#include <stddef.h>
+#include <stdint.h>
+
 #define MXA_MAGIC "MXA\0"
+/* Archives with an embedded dictionary, so unpackers without LZ_DICT refuse them outright. */
+#define MXA_MAGIC_DICT "MXA\1"
 #define MXA_MAGIC_LEN 4
 #define FILENAME_LEN_BYTE 1
 #define FILESIZE_LEN_BYTE 4
@@ -10,6 +15,9 @@
 #define COMPRESSION_NONE 0x00
 #define COMPRESSION_RLE 0x01
 #define COMPRESSION_LZ_LITE 0x02
+#define COMPRESSION_LZ_DICT 0x03
+/* Not a member: the dictionary used by LZ_DICT members that follow it. */
+#define COMPRESSION_DICT_ENTRY 0x80
 
 #define RLE_MARKER 0xFF
 #define RLE_MAX_REPEAT 255
@@ -18,6 +26,49 @@
 #define LZ_LITE_WINDOW_SIZE 255
 #define LZ_LITE_MIN_MATCH 2
 #define LZ_LITE_MAX_MATCH 16
+#define LZ_LITE_PREV_SIZE 256
+
+/* Token: marker, length - LZ_DICT_MIN_MATCH + 1, 16-bit LE offset. Marker, 0 is a literal marker. */
+#define LZ_DICT_MARKER 0xFD
+#define LZ_DICT_WINDOW_SIZE 65535
+#define LZ_DICT_MIN_MATCH 5
+#define LZ_DICT_MAX_MATCH (LZ_DICT_MIN_MATCH + 254)
+#define LZ_DICT_HASH_SIZE 65536
+#define LZ_DICT_PREV_SIZE 65536
+#define LZ_DICT_CHAIN_DEPTH 32
+
+#define MXA_CTX_MIN_BUFFER (64 * 1024)
+
+struct mxa_dict;
+
+enum mxa_ctx_buffer {
+    MXA_BUF_INPUT = 0,
+    MXA_BUF_OUTPUT,
+    MXA_BUF_COUNT
+};
+
+/*
+ * Buffers and LZ match tables reused across members and archives. Buffers
+ * are page-aligned, sized in power-of-two classes and only ever grow.
+ * A context is not thread-safe: give each worker thread its own.
+ */
+struct mxa_codec_ctx {
+    unsigned char *buffers[MXA_BUF_COUNT];
+    size_t buffer_sizes[MXA_BUF_COUNT];
+    uint32_t *lz_head;
+    uint32_t *lz_prev;
+    uint32_t lz_base;
+    uint32_t *lzd_head;
+    uint32_t *lzd_prev;
+    uint32_t lzd_base;
+    const struct mxa_dict *dict;
+};
+
+struct mxa_codec_ctx *mxa_ctx_create(void);
+void mxa_ctx_destroy(struct mxa_codec_ctx *ctx);
+unsigned char *mxa_ctx_buffer(struct mxa_codec_ctx *ctx, enum mxa_ctx_buffer which, size_t size);
+int mxa_ctx_lz_tables(struct mxa_codec_ctx *ctx, size_t in_len);
+int mxa_ctx_dict_tables(struct mxa_codec_ctx *ctx, size_t in_len);
 
 int mxa_pack_cmd(int argc, char *argv[]);
 int mxa_unpack_cmd(int argc, char *argv[]);
@@ -0,0 +1,344 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "mxa_uring.h"
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define MXA_HAVE_URING 1
+#endif
+#endif
+
+#ifdef MXA_HAVE_URING
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+
+/* Headers older than 5.18 lack it; the kernel reports the feature at setup either way. */
+#ifndef IORING_FEAT_LINKED_FILE
+#define IORING_FEAT_LINKED_FILE (1U << 12)
+#endif
+
+/* Each file is one openat -> read -> close chain of three SQEs. */
+#define MXA_URING_ENTRIES (MXA_URING_BATCH * 3)
+
+#define OP_OPEN 0
+#define OP_DATA 1
+#define OP_CLOSE 2
+
+struct mxa_uring {
+    int ring_fd;
+    unsigned int sq_entries;
+    unsigned int *sq_head;
+    unsigned int *sq_tail;
+    unsigned int *sq_mask;
+    unsigned int *sq_array;
+    unsigned int *cq_head;
+    unsigned int *cq_tail;
+    unsigned int *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void *sq_ring;
+    size_t sq_ring_size;
+    void *cq_ring;
+    size_t cq_ring_size;
+    size_t sqes_size;
+    unsigned char *buffers;
+    size_t buffers_size;
+    int fixed_buffers;
+    unsigned int queued;
+};
+
+static int uring_setup(unsigned int entries, struct io_uring_params *params) {
+    return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int uring_enter(int fd, unsigned int to_submit, unsigned int min_complete, unsigned int flags) {
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static int uring_register(int fd, unsigned int opcode, const void *arg, unsigned int nr_args) {
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+struct mxa_uring *mxa_uring_create(void) {
+    struct mxa_uring *ring = (struct mxa_uring *)calloc(1, sizeof(*ring));
+    if (ring == NULL) return NULL;
+    ring->ring_fd = -1;
+
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    ring->ring_fd = uring_setup(MXA_URING_ENTRIES, &params);
+    /*
+     * Files are opened straight into the ring's file table and the linked read picks them up
+     * from there, which needs the late fixed-file lookup that came with IORING_FEAT_LINKED_FILE in 5.18.
+     */
+    if (ring->ring_fd < 0 || !(params.features & IORING_FEAT_LINKED_FILE)) {
+        mxa_uring_destroy(ring);
+        return NULL;
+    }
+
+    ring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+    ring->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        if (ring->cq_ring_size > ring->sq_ring_size) ring->sq_ring_size = ring->cq_ring_size;
+        ring->cq_ring_size = ring->sq_ring_size;
+    }
+    ring->sq_ring = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                    ring->ring_fd, IORING_OFF_SQ_RING);
+    if (ring->sq_ring == MAP_FAILED) {
+        ring->sq_ring = NULL;
+        mxa_uring_destroy(ring);
+        return NULL;
+    }
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        ring->cq_ring = ring->sq_ring;
+    } else {
+        ring->cq_ring = mmap(NULL, ring->cq_ring_size, PROT_READ | PROT_WRITE,
+                                        MAP_SHARED | MAP_POPULATE, ring->ring_fd, IORING_OFF_CQ_RING);
+        if (ring->cq_ring == MAP_FAILED) {
+            ring->cq_ring = NULL;
+            mxa_uring_destroy(ring);
+            return NULL;
+        }
+    }
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                 ring->ring_fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) {
+        ring->sqes = NULL;
+        mxa_uring_destroy(ring);
+        return NULL;
+    }
+
+    char *sq = (char *)ring->sq_ring;
+    char *cq = (char *)ring->cq_ring;
+    ring->sq_entries = params.sq_entries;
+    ring->sq_head = (unsigned int *)(sq + params.sq_off.head);
+    ring->sq_tail = (unsigned int *)(sq + params.sq_off.tail);
+    ring->sq_mask = (unsigned int *)(sq + params.sq_off.ring_mask);
+    ring->sq_array = (unsigned int *)(sq + params.sq_off.array);
+    ring->cq_head = (unsigned int *)(cq + params.cq_off.head);
+    ring->cq_tail = (unsigned int *)(cq + params.cq_off.tail);
+    ring->cq_mask = (unsigned int *)(cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+
+    ring->buffers_size = (size_t)MXA_URING_BATCH * MXA_URING_SLOT_SIZE;
+    ring->buffers = mmap(NULL, ring->buffers_size, PROT_READ | PROT_WRITE,
+                                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ring->buffers == MAP_FAILED) {
+        ring->buffers = NULL;
+        mxa_uring_destroy(ring);
+        return NULL;
+    }
+    struct iovec iov[MXA_URING_BATCH];
+    for (unsigned int i = 0; i < MXA_URING_BATCH; ++i) {
+        iov[i].iov_base = ring->buffers + (size_t)i * MXA_URING_SLOT_SIZE;
+        iov[i].iov_len = MXA_URING_SLOT_SIZE;
+    }
+    /* Registration pins the slots and can fail under a low RLIMIT_MEMLOCK; plain READ still works. */
+    ring->fixed_buffers = uring_register(ring->ring_fd, IORING_REGISTER_BUFFERS, iov, MXA_URING_BATCH) == 0;
+
+    /* One empty file table slot per batch index. */
+    int slots[MXA_URING_BATCH];
+    for (unsigned int i = 0; i < MXA_URING_BATCH; ++i) {
+        slots[i] = -1;
+    }
+    if (uring_register(ring->ring_fd, IORING_REGISTER_FILES, slots, MXA_URING_BATCH) != 0) {
+        mxa_uring_destroy(ring);
+        return NULL;
+    }
+    return ring;
+}
+
+void mxa_uring_destroy(struct mxa_uring *ring) {
+    if (ring == NULL) return;
+    if (ring->buffers) munmap(ring->buffers, ring->buffers_size);
+    if (ring->sqes) munmap(ring->sqes, ring->sqes_size);
+    if (ring->cq_ring && ring->cq_ring != ring->sq_ring) munmap(ring->cq_ring, ring->cq_ring_size);
+    if (ring->sq_ring) munmap(ring->sq_ring, ring->sq_ring_size);
+    if (ring->ring_fd >= 0) close(ring->ring_fd);
+    free(ring);
+}
+
+unsigned char *mxa_uring_slot(struct mxa_uring *ring, unsigned int slot) {
+    return ring->buffers + (size_t)slot * MXA_URING_SLOT_SIZE;
+}
+
+static struct io_uring_sqe *get_sqe(struct mxa_uring *ring, unsigned int index, unsigned int op) {
+    unsigned int tail = *ring->sq_tail + ring->queued;
+    unsigned int slot = tail & *ring->sq_mask;
+    struct io_uring_sqe *sqe = &ring->sqes[slot];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->user_data = ((unsigned long long)index << 2) | op;
+    ring->sq_array[slot] = slot;
+    ring->queued++;
+    return sqe;
+}
+
+/* Publishes the queued SQEs and hands each completion to cb until all of them are reaped. */
+static int submit_and_reap(struct mxa_uring *ring, void (*cb)(struct mxa_uring *, struct mxa_uring_file *,
+                                                               unsigned int, unsigned int, int),
+                           struct mxa_uring_file *files) {
+    unsigned int to_submit = ring->queued;
+    unsigned int outstanding = to_submit;
+    atomic_store_explicit((_Atomic unsigned int *)ring->sq_tail, *ring->sq_tail + to_submit, memory_order_release);
+    ring->queued = 0;
+
+    while (outstanding > 0) {
+        int ret = uring_enter(ring->ring_fd, to_submit, 1, IORING_ENTER_GETEVENTS);
+        if (ret < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        to_submit -= (unsigned int)ret < to_submit ? (unsigned int)ret : to_submit;
+        unsigned int head = *ring->cq_head;
+        unsigned int tail = atomic_load_explicit((_Atomic unsigned int *)ring->cq_tail, memory_order_acquire);
+        while (head != tail) {
+            struct io_uring_cqe *cqe = &ring->cqes[head & *ring->cq_mask];
+            cb(ring, files, (unsigned int)(cqe->user_data >> 2), (unsigned int)(cqe->user_data & 3), cqe->res);
+            head++;
+            outstanding--;
+        }
+        atomic_store_explicit((_Atomic unsigned int *)ring->cq_head, head, memory_order_release);
+    }
+    return 0;
+}
+
+static void set_err(struct mxa_uring_file *file, int err) {
+    if (file->err == 0) file->err = err;
+}
+
+/* Empties a file table slot whose close was cancelled by a broken link. */
+static void clear_slot(struct mxa_uring *ring, unsigned int index) {
+    int fd = -1;
+    struct io_uring_files_update update;
+    memset(&update, 0, sizeof(update));
+    update.offset = index;
+    update.fds = (unsigned long long)(uintptr_t)&fd;
+    uring_register(ring->ring_fd, IORING_REGISTER_FILES_UPDATE, &update, 1);
+}
+
+static void on_completion(struct mxa_uring *ring, struct mxa_uring_file *files,
+                          unsigned int index, unsigned int op, int res) {
+    struct mxa_uring_file *file = &files[index];
+    switch (op) {
+        case OP_OPEN:
+            if (res < 0) {
+                set_err(file, -res);
+            } else {
+                file->fd = (int)index;
+            }
+            break;
+        case OP_DATA:
+            if (res < 0) {
+                set_err(file, -res);
+            } else if ((size_t)res != file->size) {
+                set_err(file, EIO);
+            }
+            break;
+        case OP_CLOSE:
+            /* A failed open or a short transfer breaks the link and cancels the close. */
+            if (res == -ECANCELED) {
+                if (file->fd >= 0) clear_slot(ring, index);
+            } else if (res < 0) {
+                set_err(file, -res);
+            }
+            file->fd = -1;
+            break;
+    }
+}
+
+/* Queues openat into file table slot index, the read and the close as one linked chain. */
+static void queue_chain(struct mxa_uring *ring, struct mxa_uring_file *file, unsigned int index) {
+    struct io_uring_sqe *sqe = get_sqe(ring, index, OP_OPEN);
+    sqe->opcode = IORING_OP_OPENAT;
+    sqe->fd = AT_FDCWD;
+    sqe->addr = (unsigned long long)(uintptr_t)file->path;
+    /* O_NONBLOCK keeps a file swapped for a FIFO since the stat from blocking; no O_CLOEXEC, as slots are not fds. */
+    sqe->open_flags = O_RDONLY | O_NONBLOCK;
+    sqe->file_index = index + 1;
+    sqe->flags = IOSQE_IO_LINK;
+
+    sqe = get_sqe(ring, index, OP_DATA);
+    if (ring->fixed_buffers) {
+        sqe->opcode = IORING_OP_READ_FIXED;
+        sqe->buf_index = (__u16)index;
+    } else {
+        sqe->opcode = IORING_OP_READ;
+    }
+    sqe->fd = (int)index;
+    sqe->addr = (unsigned long long)(uintptr_t)mxa_uring_slot(ring, index);
+    sqe->len = (unsigned int)file->size;
+    sqe->off = 0;
+    sqe->flags = IOSQE_FIXED_FILE | IOSQE_IO_LINK;
+
+    sqe = get_sqe(ring, index, OP_CLOSE);
+    sqe->opcode = IORING_OP_CLOSE;
+    sqe->file_index = index + 1;
+}
+
+/*
+ * stat() runs inline: IORING_OP_STATX is always punted to a worker thread, which cost more than it saved.
+ * Only regular files are opened, since opening a FIFO blocks until a writer shows up.
+ */
+int mxa_uring_read_files(struct mxa_uring *ring, struct mxa_uring_file *files, unsigned int count) {
+    if (count > MXA_URING_BATCH) return -1;
+    for (unsigned int i = 0; i < count; ++i) {
+        struct mxa_uring_file *file = &files[i];
+        struct stat st;
+        file->err = 0;
+        file->fd = -1;
+        file->size = 0;
+        file->mode = 0;
+        if (stat(file->path, &st) != 0) {
+            file->err = errno;
+            continue;
+        }
+        file->size = (size_t)st.st_size;
+        file->mode = st.st_mode;
+        if (!S_ISREG(file->mode)) {
+            file->err = EINVAL;
+        } else if (file->size > MXA_URING_SLOT_SIZE) {
+            file->err = EFBIG;
+        } else if (file->size > 0) {
+            queue_chain(ring, file, i);
+        }
+    }
+    if (ring->queued > 0 && submit_and_reap(ring, on_completion, files) != 0) return -1;
+    return 0;
+}
+
+#else
+
+struct mxa_uring *mxa_uring_create(void) {
+    return NULL;
+}
+
+void mxa_uring_destroy(struct mxa_uring *ring) {
+    (void)ring;
+}
+
+unsigned char *mxa_uring_slot(struct mxa_uring *ring, unsigned int slot) {
+    (void)ring;
+    (void)slot;
+    return NULL;
+}
+
+int mxa_uring_read_files(struct mxa_uring *ring, struct mxa_uring_file *files, unsigned int count) {
+    (void)ring;
+    (void)files;
+    (void)count;
+    return -1;
+}
+
+#endif
@@ -0,0 +1,30 @@
+#ifndef MXA_URING_H
+#define MXA_URING_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+/*
+ * io_uring batches only the member reads of mxa pack. Unpack writes its
+ * members synchronously: batched O_CREAT opens are punted to io-wq and
+ * measured slower than plain calls.
+ */
+#define MXA_URING_BATCH 64
+#define MXA_URING_SLOT_SIZE (64 * 1024)
+
+struct mxa_uring;
+
+struct mxa_uring_file {
+    const char *path;
+    size_t size;
+    mode_t mode;
+    int err;
+    int fd;
+};
+
+struct mxa_uring *mxa_uring_create(void);
+void mxa_uring_destroy(struct mxa_uring *ring);
+unsigned char *mxa_uring_slot(struct mxa_uring *ring, unsigned int slot);
+int mxa_uring_read_files(struct mxa_uring *ring, struct mxa_uring_file *files, unsigned int count);
+
+#endif
@@ -0,0 +1,29 @@
+# Helpers shared by the test cases; sourced with the scratch directory as cwd.
+set -e
+
+fail() {
+    echo "$*" >&2
+    exit 1
+}
+
+# Builds a small tree with nested and empty directories, a symlink and a
+# file with unusual permissions under $1.
+make_tree() {
+    mkdir -p "$1/a/b/c" "$1/empty" "$1/d"
+    echo "top" > "$1/top.txt"
+    printf 'line %s\n' 1 2 3 4 5 > "$1/a/lines.txt"
+    head -c 300000 /dev/urandom > "$1/a/b/random.bin"
+    : > "$1/a/b/c/zero"
+    for i in 1 2 3 4 5 6 7 8 9 10; do echo "file $i" > "$1/d/f$i"; done
+    chmod 640 "$1/d/f3"
+    ln -s ../top.txt "$1/a/link"
+}
+
+# Compares two trees by content, type and permission bits.
+same_tree() {
+    diff -r --no-dereference "$1" "$2" || fail "trees $1 and $2 differ"
+    (cd "$1" && find . -printf '%p %y %m\n' | sort) > "$1.list"
+    (cd "$2" && find . -printf '%p %y %m\n' | sort) > "$2.list"
+    cmp -s "$1.list" "$2.list" || fail "types or modes differ between $1 and $2"
+    rm -f "$1.list" "$2.list"
+}
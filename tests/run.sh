@@ -0,0 +1,26 @@
+#!/bin/sh
+# Runs every tests/t_*.sh case in a scratch directory against the mx binary
+# given as $1. Cases exit non-zero on failure and may print why.
+if [ $# -ne 1 ]; then
+    echo "Usage: $0 <path/to/mx>" >&2
+    exit 2
+fi
+MX=$(cd "$(dirname "$1")" && pwd)/$(basename "$1")
+TESTS=$(cd "$(dirname "$0")" && pwd)
+export MX TESTS
+
+failed=0
+for t in "$TESTS"/t_*.sh; do
+    name=$(basename "$t" .sh)
+    work=$(mktemp -d "${TMPDIR:-/tmp}/mx-test.XXXXXX")
+    if (cd "$work" && sh "$t") > "$work.log" 2>&1; then
+        echo "PASS $name"
+    else
+        echo "FAIL $name"
+        sed 's/^/    /' "$work.log"
+        failed=1
+    fi
+    chmod -R u+rwx "$work" 2>/dev/null
+    rm -rf "$work" "$work.log"
+done
+exit $failed
@@ -0,0 +1,37 @@
+# mx cp: single files, recursive tree copies, symlinked operands, pseudo files.
+. "$TESTS/lib.sh"
+
+make_tree src
+"$MX" cp -r src copy
+same_tree src copy
+[ -L copy/a/link ] || fail "symlink inside the tree was not copied as a link"
+
+mkdir into
+"$MX" cp -r src into
+same_tree src into/src
+
+"$MX" cp src/a/b/random.bin one.bin
+cmp src/a/b/random.bin one.bin || fail "single file copy differs"
+"$MX" cp src/top.txt src/a/lines.txt into
+cmp src/a/lines.txt into/lines.txt || fail "copy into a directory differs"
+
+ln -s src lnk
+"$MX" cp -r lnk via_link || fail "cp -r through a symlinked operand failed"
+same_tree src via_link
+
+if "$MX" cp -r missing nowhere 2>/dev/null; then fail "cp of a missing source succeeded"; fi
+[ ! -e nowhere ] || fail "failed cp left a destination behind"
+if "$MX" cp src/top.txt src/top.txt 2>/dev/null; then fail "cp onto itself succeeded"; fi
+
+"$MX" cp /proc/self/status status
+[ -s status ] || fail "copy of a /proc file is empty"
+grep -q '^Name:' status || fail "copy of a /proc file is not its content"
+
+# An existing destination directory keeps its mode; directories cp creates take the source's.
+mkdir -p modes/sub existing/modes
+chmod 700 modes/sub
+chmod 755 modes
+chmod 750 existing/modes
+"$MX" cp -r modes existing
+[ "$(stat -c %a existing/modes)" = 750 ] || fail "cp changed the mode of an existing directory"
+[ "$(stat -c %a existing/modes/sub)" = 700 ] || fail "created directory did not get the source mode"
@@ -0,0 +1,41 @@
+# External commands: PATH lookup, exit statuses, the hash cache and its
+# recovery when a cached binary disappears.
+. "$TESTS/lib.sh"
+
+mkdir bin1 bin2
+printf '#!/bin/sh\necho one "$@"\n' > bin1/tool
+printf '#!/bin/sh\necho two "$@"\n' > bin2/tool
+printf '#!/bin/sh\nexit 3\n' > bin1/three
+chmod +x bin1/tool bin2/tool bin1/three
+export PATH="$PWD/bin1:$PWD/bin2:$PATH"
+
+[ "$("$MX" -c 'tool a b')" = "one a b" ] || fail "PATH lookup picked the wrong binary"
+
+status=0
+"$MX" -c three || status=$?
+[ $status -eq 3 ] || fail "exit status $status instead of 3"
+
+status=0
+"$MX" -c nosuch_command_xyz 2>/dev/null || status=$?
+[ $status -eq 127 ] || fail "missing command gave $status instead of 127"
+
+out=$("$MX" -c "tool
+rm bin1/tool
+tool
+hash")
+echo "$out" | sed -n 1p | grep -qx 'one' || fail "first lookup: $out"
+echo "$out" | sed -n 2p | grep -qx 'two' || fail "stale hash entry not refreshed: $out"
+echo "$out" | grep -q "$PWD/bin2/tool" || fail "hash does not list the refreshed path: $out"
+
+# A hit in a relative PATH entry is looked up again after cd.
+mkdir -p rel1/bin rel2/bin
+printf '#!/bin/sh\necho rel1\n' > rel1/bin/reltool
+printf '#!/bin/sh\necho rel2\n' > rel2/bin/reltool
+chmod +x rel1/bin/reltool rel2/bin/reltool
+out=$(PATH="bin:$PATH" "$MX" -c "cd rel1
+reltool
+cd ../rel2
+reltool
+hash")
+[ "$(echo "$out" | sed -n 1,2p | tr '\n' ' ')" = "rel1 rel2 " ] || fail "relative PATH hit was cached across cd: $out"
+if echo "$out" | grep -q reltool; then fail "relative PATH hit was hashed: $out"; fi
@@ -0,0 +1,74 @@
+# grep --index prints the same lines as a plain grep over every file of the tree.
+. "$TESTS/lib.sh"
+
+mkdir -p tree/sub/deeper tree/empty
+for i in 1 2 3 4 5 6 7 8 9 10 11 12; do
+    printf 'line one %s\nneedle in file %s\nthe haystack\n' "$i" "$i" > "tree/f$i.log"
+done
+printf 'needle\nneedle needle\nno\n' > tree/sub/twice.txt
+printf 'nothing here\n' > tree/sub/deeper/none.txt
+head -c 150000 /dev/urandom > tree/sub/random.bin
+printf 'needle split across the end of a long line ' > tree/sub/long.txt
+head -c 70000 /dev/zero | tr '\0' 'x' >> tree/sub/long.txt
+printf ' needle\n' >> tree/sub/long.txt
+printf 'ab\n' > tree/short.txt
+
+# Plain grep on each file in index order, prefixed the way --index names files.
+# Without -m, --index prints only the lines that match, like -m>0.
+expect() {
+    case " $*" in *" -m"*) ;; *) set -- '-m>0' "$@" ;; esac
+    (cd tree && find . -type f ! -name '.mxgrip.idx*' | sed 's|^\./||' | LC_ALL=C sort) | while read -r f; do
+        "$MX" grep "$@" "tree/$f" | sed "s|^|tree/$f:|"
+    done
+}
+
+check() {
+    expect "$@" > want.txt
+    "$MX" grep "$@" --index tree > got.txt 2> err.txt || fail "grep --index $* failed: $(cat err.txt)"
+    cmp -s want.txt got.txt || fail "grep --index $* differs from plain grep: $(diff want.txt got.txt)"
+}
+
+[ "$("$MX" grep needle tree/f1.log | wc -l)" -eq 3 ] || fail "plain grep without -m no longer prints every line"
+
+"$MX" grep --build-index tree > /dev/null
+for pattern in needle haystack 'line one 1' zzz ab x; do
+    check "$pattern"
+done
+check -n needle
+check -s needle
+check '-m>1' needle
+check '-m<1' needle
+check '-m=0' needle
+
+# Files added, changed or removed after the build are found without a rebuild.
+printf 'a new needle\n' > tree/sub/added.txt
+printf 'late needle\n' > tree/zz_added.txt
+sleep 0.01
+printf 'needle rewritten\n' > tree/f3.log
+rm tree/f4.log
+check needle
+grep -q '3 files added or changed' err.txt || fail "stale files not reported: $(cat err.txt)"
+"$MX" grep --build-index tree > /dev/null
+check needle
+[ ! -s err.txt ] || fail "fresh index still reported stale files: $(cat err.txt)"
+
+# A build that spills sorted runs to disk writes the same index as one held in memory.
+cp tree/.mxgrip.idx in_memory.idx
+rm tree/.mxgrip.idx
+MGRIP_SORT_MEM=1024 "$MX" grep --build-index tree > /dev/null
+cmp in_memory.idx tree/.mxgrip.idx || fail "spilled build differs from the in-memory one"
+[ -z "$(ls -A tree | grep -v '^f\|^sub$\|^empty$\|^short.txt$\|^zz_added.txt$\|^\.mxgrip\.idx$')" ] ||
+    fail "build left files behind: $(ls -A tree)"
+check needle
+MGRIP_SORT_MEM=1024 "$MX" grep --build-index tree > /dev/null
+cmp in_memory.idx tree/.mxgrip.idx || fail "spilled rebuild from reused postings differs"
+
+# Concurrent builds each write their own temporary file.
+pids=
+for i in 1 2 3 4; do
+    "$MX" grep --build-index tree > /dev/null &
+    pids="$pids $!"
+done
+wait $pids
+cmp in_memory.idx tree/.mxgrip.idx || fail "concurrent builds left a damaged index"
+[ -z "$(ls -A tree | grep '^\.mxgrip\.idx\.')" ] || fail "concurrent builds left files behind: $(ls -A tree)"
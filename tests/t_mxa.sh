@@ -0,0 +1,57 @@
+# mxa pack/unpack: round trips per codec and I/O path, odd members.
+. "$TESTS/lib.sh"
+
+mkdir src
+for i in $(seq 1 150); do
+    head -c $((i * 37)) "$TESTS/lib.sh" > "src/small$i.txt"
+done
+: > src/empty
+head -c 200000 /dev/urandom > src/big.bin
+printf 'aaaaaaaaaaaaaaaabbbbbbbbbbbbbbbbbbbbbbbbb\n%.0s' $(seq 1 500) > src/runs.txt
+# Runs of the RLE marker byte and of zero bytes, which sit next to it in the encoding.
+{ head -c 300 /dev/zero; printf 'x'; head -c 2 /dev/zero; head -c 300 /dev/zero | tr '\0' '\377'; printf '\377\377y'; } > src/marker.bin
+
+for io in uring sync; do
+    for codec in -n -m -d; do
+        out="out$codec.$io"
+        MXA_IO=$io "$MX" mxa pack $codec "$out.mxa" src/* > /dev/null
+        mkdir "$out"
+        (cd "$out" && MXA_IO=$io "$MX" mxa unpack "../$out.mxa" > /dev/null)
+        same_tree src "$out"
+    done
+    cmp out-n.$io.mxa out-n.uring.mxa || fail "$io and uring packs differ"
+done
+
+# A FIFO member is skipped instead of waiting forever for a writer.
+mkdir d
+echo hi > d/a.txt
+mkfifo d/ff
+for io in uring sync; do
+    MXA_IO=$io timeout 5 "$MX" mxa pack fifo.mxa d/a.txt d/ff > /dev/null 2> fifo.err ||
+        fail "$io pack with a FIFO member failed or hung"
+    grep -q 'ff: not a regular file' fifo.err || fail "FIFO member was not reported on the $io path"
+    mkdir fifo.$io
+    (cd fifo.$io && "$MX" mxa unpack ../fifo.mxa > /dev/null)
+    [ "$(ls fifo.$io)" = "a.txt" ] || fail "FIFO member ended up in the $io archive"
+done
+timeout 5 "$MX" mxa pack single.mxa d/ff > /dev/null 2>&1 || fail "pack of a lone FIFO failed or hung"
+
+if "$MX" mxa pack missing.mxa d/a.txt d/nope > /dev/null 2>&1; then fail "pack with a missing member succeeded"; fi
+
+# Trained dictionaries: -D round trips and marks the archive so older unpackers refuse it.
+"$MX" mxa train dict.mxd src/small*.txt > /dev/null
+"$MX" mxa pack -D dict.mxd dict.mxa src/* > /dev/null
+[ "$(head -c 4 dict.mxa | od -An -c | tr -d ' ')" = 'MXA001' ] || fail "archive with a dictionary kept the old magic"
+[ "$(head -c 4 out-d.sync.mxa | od -An -c | tr -d ' ')" = 'MXA\0' ] || fail "archive without a dictionary changed magic"
+mkdir dict
+(cd dict && "$MX" mxa unpack ../dict.mxa > /dev/null)
+same_tree src dict
+if "$MX" mxa pack -D dict.mxd -d both.mxa src/top.txt 2>/dev/null; then fail "-D with -d was accepted"; fi
+if "$MX" mxa pack -m -D dict.mxd both.mxa src/top.txt 2>/dev/null; then fail "-m with -D was accepted"; fi
+[ ! -e both.mxa ] || fail "rejected option combination created an archive"
+
+head -c 5000 /dev/urandom > noise1
+head -c 5000 /dev/urandom > noise2
+if "$MX" mxa train -s 1024 noise.mxd noise1 noise2 2>/dev/null; then fail "train without repeats succeeded"; fi
+[ ! -e noise.mxd ] || fail "train without repeats wrote a dictionary"
+timeout 5 "$MX" mxa train fifo.mxd d/ff src/small1*.txt > /dev/null 2>&1 || fail "train with a FIFO sample failed or hung"
@@ -0,0 +1,42 @@
+# Pipelines and redirections: mixed builtin/external stages, <, >, >>,
+# builtins that must change the shell, and syntax errors.
+. "$TESTS/lib.sh"
+
+printf 'alpha\nbeta\ngamma\n' > in.txt
+head -c 3000000 /dev/urandom | od -An -tx1 > big.txt
+
+"$MX" -c "cat big.txt | cat | cat > piped.txt"
+cmp big.txt piped.txt || fail "cat | cat | cat changed the data"
+
+"$MX" -c "cat < big.txt | wc -c > count.txt"
+[ "$(tr -d ' ' < count.txt)" = "$(wc -c < big.txt | tr -d ' ')" ] || fail "byte count through a pipe differs"
+
+"$MX" -c "cat in.txt | grep -s amm > grep.txt"
+grep -q amm grep.txt && [ "$(wc -l < grep.txt)" -eq 1 ] || fail "grep in a pipeline: $(cat grep.txt)"
+
+"$MX" -c "grep -s et < in.txt > redir.txt"
+grep -q et redir.txt || fail "grep with < and > produced: $(cat redir.txt)"
+
+"$MX" -c "echo one > out.txt
+echo two >> out.txt"
+[ "$(cat out.txt)" = "$(printf 'one\ntwo')" ] || fail "> and >> produced: $(cat out.txt)"
+
+mkdir sub
+"$MX" -c "cd sub > cd.txt
+echo here > marker.txt"
+[ -f cd.txt ] && [ -f sub/marker.txt ] || fail "a redirected cd did not change the shell directory"
+
+status=0
+"$MX" -c "exit 5 > exit.txt
+echo unreachable > after.txt" || status=$?
+[ $status -eq 5 ] && [ ! -e after.txt ] || fail "a redirected exit did not end the shell (status $status)"
+
+out=$(printf 'grep -s alpha < in.txt\necho after\n' | "$MX")
+echo "$out" | grep -q after || fail "a redirected builtin swallowed the rest of the script: $out"
+
+status=0
+"$MX" -c "cat in.txt |" 2>/dev/null || status=$?
+[ $status -eq 2 ] || fail "syntax error gave status $status"
+status=0
+"$MX" -c "cat >" 2>/dev/null || status=$?
+[ $status -eq 2 ] || fail "missing redirection target gave status $status"
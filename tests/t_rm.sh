@@ -0,0 +1,25 @@
+# mx rm: recursive removal of a tree, -f on missing paths, and the RLIMIT_NOFILE
+# soft limit being left as it was.
+. "$TESTS/lib.sh"
+
+make_tree tree
+i=0
+while [ $i -lt 40 ]; do
+    mkdir -p "wide/d$i/x/y"
+    echo $i > "wide/d$i/x/y/f"
+    i=$((i + 1))
+done
+"$MX" rm -r tree wide
+[ ! -e tree ] && [ ! -e wide ] || fail "rm -r left files behind"
+
+"$MX" rm -f missing || fail "rm -f on a missing path failed"
+if "$MX" rm missing 2>/dev/null; then fail "rm on a missing path succeeded"; fi
+mkdir dir
+if "$MX" rm dir 2>/dev/null; then fail "rm without -r removed a directory"; fi
+
+make_tree tree
+limits=$(ulimit -Sn 64 && "$MX" -c "cat /proc/self/limits
+rm -r tree
+cat /proc/self/limits" | grep 'Max open files')
+[ "$(echo "$limits" | sed -n 1p)" = "$(echo "$limits" | sed -n 2p)" ] ||
+    fail "rm changed the open files limit: $limits"
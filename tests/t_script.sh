@@ -0,0 +1,39 @@
+# Script mode: mx -c, mx FILE, mx -- FILE, scripts on stdin, comments,
+# long lines and the exit status of the last line.
+. "$TESTS/lib.sh"
+
+[ "$("$MX" -c 'echo a b   c')" = "a b c" ] || fail "mx -c word splitting"
+
+cat > script.mx <<'SCRIPT'
+# a comment line
+
+echo first   # trailing comment
+mkdir made
+echo second > made/out.txt
+cat made/out.txt
+SCRIPT
+[ "$("$MX" script.mx)" = "$(printf 'first\nsecond')" ] || fail "script file output: $("$MX" script.mx)"
+rm -r made
+
+[ "$("$MX" < script.mx)" = "$(printf 'first\nsecond')" ] || fail "script on stdin"
+rm -r made
+
+printf 'echo from script\n' > ls
+[ "$("$MX" -- ls)" = "from script" ] || fail "mx -- ls did not run the script"
+[ "$("$MX" ./ls)" = "from script" ] || fail "mx ./ls did not run the script"
+"$MX" ls | grep -qx script.mx || fail "mx ls no longer runs the builtin"
+
+long=$(i=0; while [ $i -lt 1500 ]; do printf 'word%d ' $i; i=$((i + 1)); done)
+[ "$("$MX" -c "echo $long | cat")" = "$(echo $long)" ] || fail "a 1500-word line was not run in full"
+mkdir many
+files=$(i=1; while [ $i -le 100 ]; do echo $i > "f$i"; printf 'f%d ' $i; i=$((i + 1)); done)
+"$MX" -c "cp $files many" || fail "cp with 100 operands failed"
+[ "$(ls many | wc -l)" -eq 100 ] || fail "cp with 100 operands copied $(ls many | wc -l) files"
+long=$(i=0; while [ $i -lt 60 ]; do printf 'a_rather_long_word_number_%d_xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx ' $i; i=$((i + 1)); done)
+[ "$("$MX" -c "echo $long" | wc -c)" -gt 4096 ] || fail "a line longer than the stack buffer was cut"
+[ "$("$MX" -c "echo $long")" = "$(echo $long)" ] || fail "a long line was not echoed verbatim"
+
+status=0
+"$MX" -c "echo x
+sh -c false" > /dev/null || status=$?
+[ $status -eq 1 ] || fail "script status is not that of the last line ($status)"
@@ -0,0 +1,42 @@
+# mx --serve: requests carry stdio, working directory, environment and
+# umask; exit statuses, including from the exit builtin, come back.
+. "$TESTS/lib.sh"
+
+sock="$PWD/mx.sock"
+"$MX" --serve "$sock" 2> serve.log &
+server=$!
+trap 'kill $server 2>/dev/null' EXIT
+i=0
+while [ ! -S "$sock" ] && [ $i -lt 50 ]; do sleep 0.1; i=$((i + 1)); done
+[ -S "$sock" ] || fail "server did not start: $(cat serve.log)"
+
+echo hello > h.txt
+[ "$("$MX" --client "$sock" cat h.txt)" = hello ] || fail "cat through the server"
+[ "$(echo piped | "$MX" --client "$sock" cat)" = piped ] || fail "stdin not forwarded"
+
+mkdir sub
+out=$(cd sub && MY_VAR=forwarded "$MX" --client "$sock" sh -c 'echo "$MY_VAR $PWD"; umask')
+[ "$(echo "$out" | sed -n 1p)" = "forwarded $PWD/sub" ] || fail "environment or cwd not forwarded: $out"
+out=$(umask 027 && "$MX" --client "$sock" sh -c umask)
+[ "$out" = 0027 ] || fail "umask not forwarded: $out"
+
+status=0
+"$MX" --client "$sock" exit 5 2> err.txt || status=$?
+[ $status -eq 5 ] || fail "exit through the server gave $status: $(cat err.txt)"
+status=0
+"$MX" --client "$sock" grep -m=x pattern h.txt 2>/dev/null || status=$?
+[ $status -eq 1 ] || fail "failing builtin gave $status"
+
+pids=
+i=0
+while [ $i -lt 20 ]; do
+    "$MX" --client "$sock" cat h.txt > "par$i.txt" &
+    pids="$pids $!"
+    i=$((i + 1))
+done
+wait $pids
+[ "$(cat par*.txt | grep -c hello)" -eq 20 ] || fail "concurrent requests lost output"
+
+status=0
+"$MX" --client "$PWD/none.sock" cat h.txt 2>/dev/null || status=$?
+[ $status -ne 0 ] || fail "client without a server succeeded"
@@ -0,0 +1,35 @@
+# MX_STATS counters and the time builtin.
+. "$TESTS/lib.sh"
+
+printf 'alpha\nbeta\n' > small.txt
+MX_STATS=json "$MX" grep a small.txt > out.txt 2> stats.json
+grep -q '"cmd":"grep","status":0' stats.json || fail "no JSON report: $(cat stats.json)"
+grep -q '"bytes_read":11,' stats.json || fail "bytes_read: $(cat stats.json)"
+grep -q '"matches":3,' stats.json || fail "matches: $(cat stats.json)"
+# The kernel's count: read, read at end of file, one write of the output.
+grep -q '"rw_syscalls":3,' stats.json || fail "rw_syscalls for a one-block grep: $(cat stats.json)"
+
+MX_STATS=1 "$MX" cat small.txt > out.txt 2> stats.txt
+grep -q '^mx stats: cat: status=0 bytes_read=11 bytes_written=11 rw_syscalls=[0-9]' stats.txt ||
+    fail "text report: $(cat stats.txt)"
+
+# A 64 MiB line is freed once grep is done; time must not report the
+# shell's earlier peak.
+head -c 67108864 /dev/zero | tr '\0' 'x' > long.txt
+"$MX" -c "grep y long.txt
+time echo hi" > out.txt 2> time.txt
+grep -q '^hi$' out.txt || fail "time did not run its command"
+rss=$(sed -n 's/^maxrss\t\([0-9]*\) KiB$/\1/p' time.txt)
+[ -n "$rss" ] && [ "$rss" -lt 32768 ] || fail "maxrss of echo after a large grep: $(cat time.txt)"
+
+printf '#!/bin/sh\nexit 7\n' > seven
+chmod +x seven
+status=0
+"$MX" -c "time ./seven" 2>/dev/null || status=$?
+[ $status -eq 7 ] || fail "time changed the exit status ($status)"
+
+mkdir sub
+if "$MX" -c "time cd sub" 2> err.txt; then fail "time cd was accepted"; fi
+grep -q 'time: cd cannot be timed' err.txt || fail "time cd: $(cat err.txt)"
+[ "$("$MX" -c "time exit 3
+echo after" 2>/dev/null)" = after ] || fail "time exit ended the script"